@@ -0,0 +1,60 @@
+#version 430 core
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexcoord;
+
+// The draw's index into DrawDataBuffer: an instanced attribute holding 0..N,
+// offset by the command's baseInstance.
+layout(location = 8) in uint aDrawId;
+
+layout(std140, binding = 0) uniform FrameUniforms
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 viewPosition;
+	vec4 lightPosition;
+	vec4 movingLightPosition;
+	vec4 ambientColor;
+	vec4 lightColor;
+	vec4 movingLightColor;
+	vec4 directionalLightColor;
+	float shininess;
+	int enableToonShading;
+};
+
+struct DrawData
+{
+	// Includes the mesh's position decode.
+	mat4 model;
+	mat4 normalMatrix;
+	vec4 color;
+};
+
+layout(std430, binding = 2) readonly buffer DrawDataBuffer
+{
+	DrawData draws[];
+};
+
+out VertexData
+{
+	vec3 position;
+	vec3 normal;
+	vec2 texcoord;
+	vec4 color;
+} vOut;
+
+void main()
+{
+	DrawData draw = draws[aDrawId];
+
+	vec4 worldPosition = draw.model * vec4(aPosition, 1.0);
+
+	vOut.position = worldPosition.xyz;
+	vOut.normal = mat3(draw.normalMatrix) * aNormal;
+	vOut.texcoord = aTexcoord;
+	vOut.color = draw.color;
+
+	gl_Position = viewProjection * worldPosition;
+}
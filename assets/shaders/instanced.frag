@@ -0,0 +1,87 @@
+#version 430 core
+
+layout(std140, binding = 0) uniform FrameUniforms
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 viewPosition;
+	vec4 lightPosition;
+	vec4 movingLightPosition;
+	vec4 ambientColor;
+	vec4 lightColor;
+	vec4 movingLightColor;
+	vec4 directionalLightColor;
+	float shininess;
+	int enableToonShading;
+};
+
+in VertexData
+{
+	vec3 position;
+	vec3 normal;
+	vec2 texcoord;
+	vec4 color;
+} vIn;
+
+uniform sampler2D albedoMap;
+uniform sampler2D secondTexture;
+
+uniform vec3 color = vec3(1.0);
+uniform bool enableSpecular = false;
+uniform bool useSpecularMap = false;
+
+layout(location = 0) out vec4 fragColor;
+
+const vec3 kDirectionalLightDirection = vec3(-0.2, -1.0, -0.3);
+
+float shadeDiffuse(float nDotL)
+{
+	float diffuse = max(nDotL, 0.0);
+
+	// Toon shading quantizes the diffuse term into a few bands.
+	if (enableToonShading != 0)
+		diffuse = floor(diffuse * 4.0) / 4.0;
+
+	return diffuse;
+}
+
+vec3 shadeLight(vec3 toLight, vec3 radiance, vec3 N, vec3 V, vec3 albedo, float specularMask)
+{
+	vec3 L = normalize(toLight);
+
+	vec3 result = radiance * albedo * shadeDiffuse(dot(N, L));
+
+	if (enableSpecular)
+	{
+		vec3 H = normalize(L + V);
+		result += radiance * specularMask * pow(max(dot(N, H), 0.0), shininess);
+	}
+
+	return result;
+}
+
+void main()
+{
+	vec4 albedo = texture(albedoMap, vIn.texcoord);
+
+#ifdef ALPHA_TEST
+	// Cut-out textures (e.g., foliage) only: a shader that can discard loses
+	// early depth testing.
+	if (albedo.a < 0.1)
+		discard;
+#endif
+
+	vec3 baseColor = albedo.rgb * color * vIn.color.rgb;
+	float specularMask = useSpecularMap ? texture(secondTexture, vIn.texcoord).r : 1.0;
+
+	vec3 N = normalize(vIn.normal);
+	vec3 V = normalize(viewPosition.xyz - vIn.position);
+
+	vec3 result = ambientColor.rgb * baseColor;
+	result += shadeLight(lightPosition.xyz - vIn.position, lightColor.rgb, N, V, baseColor, specularMask);
+	result += shadeLight(movingLightPosition.xyz - vIn.position, movingLightColor.rgb, N, V, baseColor, specularMask);
+	result += shadeLight(-kDirectionalLightDirection, 0.3 * directionalLightColor.rgb, N, V, baseColor, specularMask);
+
+	fragColor = vec4(result, 1.0);
+}
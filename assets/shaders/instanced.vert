@@ -0,0 +1,48 @@
+#version 430 core
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexcoord;
+
+// Per-instance model matrix (locations 3-6), with the mesh's position decode
+// already applied.
+layout(location = 3) in mat4 aInstanceModel;
+layout(location = 7) in vec4 aInstanceColor;
+
+layout(std140, binding = 0) uniform FrameUniforms
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 viewPosition;
+	vec4 lightPosition;
+	vec4 movingLightPosition;
+	vec4 ambientColor;
+	vec4 lightColor;
+	vec4 movingLightColor;
+	vec4 directionalLightColor;
+	float shininess;
+	int enableToonShading;
+};
+
+out VertexData
+{
+	vec3 position;
+	vec3 normal;
+	vec2 texcoord;
+	vec4 color;
+} vOut;
+
+void main()
+{
+	vec4 worldPosition = aInstanceModel * vec4(aPosition, 1.0);
+
+	vOut.position = worldPosition.xyz;
+	// Placements may scale non-uniformly (e.g., the dog's parts), so the
+	// normals need the inverse transpose of the upper 3x3.
+	vOut.normal = transpose(inverse(mat3(aInstanceModel))) * aNormal;
+	vOut.texcoord = aTexcoord;
+	vOut.color = aInstanceColor;
+
+	gl_Position = viewProjection * worldPosition;
+}
@@ -1,74 +1,461 @@
 #include "ObjModel.hpp"
 
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
+
+#include "defaults.hpp"
+#include "mesh_arena.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "stream_buffer.hpp"
+#include "vertex_welder.hpp"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
+#include <rapidobj/rapidobj.hpp>
+
 #include <glad.h>
 
-bool ObjModel::load(const std::string& path)
+#include <glm/gtc/packing.hpp>
+
+void ObjMesh::computeBounds()
 {
-	std::string inputfile = path;
-	tinyobj::ObjReaderConfig reader_config;
+	if (vertices.empty())
+	{
+		boundsMin = boundsMax = glm::vec3(0.0f);
+		boundingSphere = glm::vec4(0.0f);
+		return;
+	}
 
-	tinyobj::ObjReader reader;
+	boundsMin = boundsMax = vertices.front().position;
 
-	if (!reader.ParseFromFile(inputfile, reader_config)) {
-		if (!reader.Error().empty()) {
-			std::cerr << "TinyObjReader: " << reader.Error();
-		}
-		return false;
+	for (const auto& vertex : vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
 	}
 
-	if (!reader.Warning().empty()) {
-		std::cout << "TinyObjReader: " << reader.Warning();
+	// Tighter than half the diagonal for anything but a box.
+	auto const center = (boundsMin + boundsMax) * 0.5f;
+
+	float radiusSquared = 0.0f;
+	for (const auto& vertex : vertices)
+	{
+		auto const offset = vertex.position - center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
 	}
 
-	auto& attrib = reader.GetAttrib();
-	auto& shapes = reader.GetShapes();
+	boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
+}
+
+const ObjLoadOptions& ObjLoadOptions::defaults()
+{
+	static const ObjLoadOptions options = [] {
+		ObjLoadOptions result;
+
+		if (const char* parser = std::getenv("OBJ_PARSER"))
+		{
+			if (std::strcmp(parser, "tinyobj") == 0)
+				result.parser = ObjParser::TinyObj;
+			else if (std::strcmp(parser, "rapidobj") == 0)
+				result.parser = ObjParser::RapidObj;
+			else
+				std::cerr << "ObjModel: unknown OBJ_PARSER '" << parser << "', using default\n";
+		}
+
+		if (const char* cache = std::getenv("OBJ_MESH_CACHE"))
+		{
+			result.useMeshCache = std::strcmp(cache, "0") != 0;
+		}
+
+		if (const char* optimize = std::getenv("OBJ_OPTIMIZE"))
+		{
+			result.optimize = std::strcmp(optimize, "0") != 0;
+		}
+
+		if (const char* lods = std::getenv("OBJ_LODS"))
+		{
+			result.generateLods = std::strcmp(lods, "0") != 0;
+		}
+
+		return result;
+	}();
+
+	return options;
+}
+
+namespace
+{
+	// Meshes with at least this many corners are collected first and welded
+	// in parallel; smaller ones are welded as they are parsed.
+	constexpr size_t kParallelWeldCorners = size_t(1) << 20;
 
-	std::unordered_map<MeshVertex, uint32_t> uniqueVertices;
+	// forEachCorner(emit) must call emit(vertex) once per index of the mesh.
+	template< typename tForEachCorner >
+	void weldMesh(ObjMesh& mesh, size_t cornerCount, tForEachCorner&& forEachCorner)
+	{
+		if (cornerCount >= kParallelWeldCorners)
+		{
+			std::vector<MeshVertex> corners;
+			corners.reserve(cornerCount);
 
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			MeshVertex vertex = {};
+			forEachCorner([&corners](const MeshVertex& vertex) { corners.push_back(vertex); });
 
-			vertex.position = {
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2]
-			};
+			weldVertices(corners, mesh.vertices, mesh.indices);
+		}
+		else
+		{
+			VertexWelder welder(mesh.vertices, cornerCount);
+			mesh.indices.reserve(mesh.indices.size() + cornerCount);
+
+			forEachCorner([&](const MeshVertex& vertex) { mesh.addIndex(welder.insert(vertex)); });
+		}
+	}
 
-			// Check if 'normal_index' is zero of positive. negative = no normal data
-			if (index.normal_index >= 0) {
-				tinyobj::real_t nx = attrib.normals[3 * size_t(index.normal_index) + 0];
-				tinyobj::real_t ny = attrib.normals[3 * size_t(index.normal_index) + 1];
-				tinyobj::real_t nz = attrib.normals[3 * size_t(index.normal_index) + 2];
-				vertex.normal = { nx, ny, nz };
+	bool parseTinyObj(const std::string& path, ObjMesh& mesh)
+	{
+		std::string inputfile = path;
+		tinyobj::ObjReaderConfig reader_config;
+
+		tinyobj::ObjReader reader;
+
+		if (!reader.ParseFromFile(inputfile, reader_config)) {
+			if (!reader.Error().empty()) {
+				std::cerr << "TinyObjReader: " << reader.Error();
 			}
+			return false;
+		}
 
-			if (index.texcoord_index >= 0)
-			{
-				vertex.texcoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				attrib.texcoords[2 * index.texcoord_index + 1]
-				};
+		if (!reader.Warning().empty()) {
+			std::cout << "TinyObjReader: " << reader.Warning();
+		}
+
+		auto& attrib = reader.GetAttrib();
+		auto& shapes = reader.GetShapes();
+
+		size_t cornerCount = 0;
+		for (const auto& shape : shapes)
+			cornerCount += shape.mesh.indices.size();
+
+		weldMesh(mesh, cornerCount, [&](auto&& emit) {
+			for (const auto& shape : shapes) {
+				for (const auto& index : shape.mesh.indices) {
+					MeshVertex vertex = {};
+
+					vertex.position = {
+						attrib.vertices[3 * index.vertex_index + 0],
+						attrib.vertices[3 * index.vertex_index + 1],
+						attrib.vertices[3 * index.vertex_index + 2]
+					};
+
+					// Check if 'normal_index' is zero of positive. negative = no normal data
+					if (index.normal_index >= 0) {
+						tinyobj::real_t nx = attrib.normals[3 * size_t(index.normal_index) + 0];
+						tinyobj::real_t ny = attrib.normals[3 * size_t(index.normal_index) + 1];
+						tinyobj::real_t nz = attrib.normals[3 * size_t(index.normal_index) + 2];
+						vertex.normal = { nx, ny, nz };
+					}
+
+					if (index.texcoord_index >= 0)
+					{
+						vertex.texcoord = {
+						attrib.texcoords[2 * index.texcoord_index + 0],
+						attrib.texcoords[2 * index.texcoord_index + 1]
+						};
+					}
+
+					emit(vertex);
+				}
 			}
+		});
 
-			if (uniqueVertices.count(vertex) == 0) {
-				uniqueVertices[vertex] = static_cast<uint32_t>(mesh.getVertices().size());
-				mesh.addVertex(vertex);
+		return true;
+	}
+
+	bool parseRapidObj(const std::string& path, ObjMesh& mesh)
+	{
+		// rapidobj maps the file and splits it into line-aligned chunks that
+		// are parsed concurrently on all hardware threads.
+		rapidobj::Result result = rapidobj::ParseFile(path);
+
+		if (result.error) {
+			std::cerr << "RapidObj: " << result.error.code.message();
+			if (!result.error.line.empty()) {
+				std::cerr << " (line " << result.error.line_num << ": " << result.error.line << ")";
 			}
+			std::cerr << "\n";
+			return false;
+		}
 
-			mesh.addIndex(uniqueVertices[vertex]);
+		// tinyobj triangulates by default; match it so both backends produce
+		// identical meshes.
+		if (!rapidobj::Triangulate(result)) {
+			std::cerr << "RapidObj: " << result.error.code.message() << "\n";
+			return false;
 		}
+
+		const auto& attributes = result.attributes;
+
+		size_t cornerCount = 0;
+		for (const auto& shape : result.shapes)
+			cornerCount += shape.mesh.indices.size();
+
+		weldMesh(mesh, cornerCount, [&](auto&& emit) {
+			for (const auto& shape : result.shapes) {
+				for (const auto& index : shape.mesh.indices) {
+					MeshVertex vertex = {};
+
+					vertex.position = {
+						attributes.positions[3 * size_t(index.position_index) + 0],
+						attributes.positions[3 * size_t(index.position_index) + 1],
+						attributes.positions[3 * size_t(index.position_index) + 2]
+					};
+
+					if (index.normal_index >= 0) {
+						vertex.normal = {
+							attributes.normals[3 * size_t(index.normal_index) + 0],
+							attributes.normals[3 * size_t(index.normal_index) + 1],
+							attributes.normals[3 * size_t(index.normal_index) + 2]
+						};
+					}
+
+					if (index.texcoord_index >= 0) {
+						vertex.texcoord = {
+							attributes.texcoords[2 * size_t(index.texcoord_index) + 0],
+							attributes.texcoords[2 * size_t(index.texcoord_index) + 1]
+						};
+					}
+
+					emit(vertex);
+				}
+			}
+		});
+
+		return true;
+	}
+}
+
+bool ObjModel::load(const std::string& path, const ObjLoadOptions& options)
+{
+	uint32_t const cacheFlags = (options.optimize ? kMeshCacheOptimized : 0u) | (options.generateLods ? kMeshCacheLods : 0u);
+
+	// Fast path: reuse the processed mesh from a previous run.
+	if (options.useMeshCache && loadMeshCache(path, mesh, cacheFlags))
+	{
+		return true;
+	}
+
+	auto const start = Clock::now();
+
+	bool parsed = false;
+	char const* parserName = "";
+
+	switch (options.parser)
+	{
+	case ObjParser::TinyObj:
+		parserName = "tinyobj";
+		parsed = parseTinyObj(path, mesh);
+		break;
+	case ObjParser::RapidObj:
+		parserName = "rapidobj";
+		parsed = parseRapidObj(path, mesh);
+		break;
+	}
+
+	if (!parsed)
+	{
+		return false;
+	}
+
+	auto const elapsed = std::chrono::duration_cast<Secondsf>(Clock::now() - start).count();
+
+	std::printf("ObjModel: loaded '%s' with %s in %.1f ms (%zu vertices, %zu indices)\n",
+		path.c_str(), parserName, elapsed * 1000.0f, mesh.vertices.size(), mesh.indices.size());
+
+	if (options.optimize)
+	{
+		auto const optimizeStart = Clock::now();
+		auto const report = optimizeMesh(mesh);
+		auto const optimizeElapsed = std::chrono::duration_cast<Secondsf>(Clock::now() - optimizeStart).count();
+
+		std::printf("ObjModel: optimized '%s' in %.1f ms (ACMR %.3f -> %.3f, ATVR %.3f -> %.3f)\n",
+			path.c_str(), optimizeElapsed * 1000.0f, report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr);
+	}
+
+	mesh.computeBounds();
+
+	if (options.generateLods)
+	{
+		auto const lodStart = Clock::now();
+		generateLods();
+		auto const lodElapsed = std::chrono::duration_cast<Secondsf>(Clock::now() - lodStart).count();
+
+		std::printf("ObjModel: built %zu LODs for '%s' in %.1f ms (",
+			mesh.lods.size(), path.c_str(), lodElapsed * 1000.0f);
+		for (size_t i = 0; i < mesh.lods.size(); ++i)
+			std::printf("%s%u", i ? ", " : "", mesh.lods[i].indexCount / 3);
+		std::printf(" triangles)\n");
+	}
+
+	if (options.useMeshCache)
+	{
+		storeMeshCache(path, mesh, cacheFlags);
 	}
 
 	return true;
 }
 
-void ObjModel::createBuffers()
+void ObjModel::generateLods()
+{
+	// Each level targets half the triangles of the previous one, within a
+	// relative error budget of 5% of the mesh extent.
+	constexpr size_t kMaxLods = 6;
+	constexpr size_t kMinLodTriangles = 64;
+	constexpr float kMaxRelativeError = 0.05f;
+
+	mesh.lodIndices.clear();
+	mesh.lods.clear();
+
+	mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+
+	auto const extents = mesh.boundsMax - mesh.boundsMin;
+	float const extent = std::max(extents.x, std::max(extents.y, extents.z));
+
+	std::vector<uint32_t> current = mesh.indices;
+	float relativeError = 0.0f;
+
+	while (mesh.lods.size() < kMaxLods)
+	{
+		size_t const target = current.size() / 6 * 3;
+		if (target < 3 * kMinLodTriangles)
+			break;
+
+		float error = 0.0f;
+		auto lod = simplifyMesh(mesh.vertices, current, target, kMaxRelativeError - relativeError, &error);
+
+		// Not worth a level of its own.
+		if (lod.size() > current.size() * 9 / 10)
+			break;
+
+		optimizeVertexCache(lod, mesh.vertices.size());
+
+		// Each level is simplified from the previous one, so the errors add up.
+		relativeError += error;
+
+		mesh.lods.push_back({ static_cast<uint32_t>(mesh.indices.size() + mesh.lodIndices.size()),
+			static_cast<uint32_t>(lod.size()), relativeError * extent });
+
+		mesh.lodIndices.insert(mesh.lodIndices.end(), lod.begin(), lod.end());
+		current.swap(lod);
+	}
+
+	if (mesh.lods.size() == 1)
+		mesh.lods.clear();
+}
+
+size_t ObjModel::selectLod(const glm::mat4& model, const glm::vec3& cameraPosition, const glm::mat4& projection,
+	float viewportHeight, float pixelError) const
+{
+	if (mesh.lods.size() < 2)
+		return 0;
+
+	// Largest axis scale of the model matrix, to bring model space errors
+	// into world space conservatively.
+	float const scale = std::max(glm::length(glm::vec3(model[0])),
+		std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+	auto const center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+	float const radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+
+	return selectLod(center, radius, scale, cameraPosition, projection, viewportHeight, pixelError);
+}
+
+size_t ObjModel::selectInstancedLod(const glm::vec3& cameraPosition, const glm::mat4& projection,
+	float viewportHeight, float pixelError) const
+{
+	if (mesh.lods.size() < 2 || instances == 0)
+		return 0;
+
+	return selectLod(glm::vec3(instanceBounds), instanceBounds.w, instanceScale, cameraPosition, projection, viewportHeight, pixelError);
+}
+
+size_t ObjModel::selectLod(const glm::vec3& center, float radius, float scale, const glm::vec3& cameraPosition,
+	const glm::mat4& projection, float viewportHeight, float pixelError) const
+{
+	// Distance to the nearest point of the bounding sphere; inside it, always
+	// draw full detail.
+	float const distance = glm::length(center - cameraPosition) - radius;
+	if (distance <= 0.0f)
+		return 0;
+
+	// projection[1][1] is cot(fovy / 2): pixels covered by one world unit at
+	// the given distance.
+	float const pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f / distance;
+
+	size_t lod = 0;
+	while (lod + 1 < mesh.lods.size() && mesh.lods[lod + 1].error * scale * pixelsPerUnit <= pixelError)
+		++lod;
+
+	return lod;
+}
+
+namespace
+{
+	// Quantizes positions to the mesh's bounding cube (uniform scale, so that
+	// normals need no extra correction) and returns the matrix that maps the
+	// snorm16 positions back to model space.
+	glm::mat4 packVertices(const std::vector<MeshVertex>& vertices, std::vector<PackedMeshVertex>& packed)
+	{
+		glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+
+		if (!vertices.empty())
+		{
+			boundsMin = boundsMax = vertices.front().position;
+
+			for (auto const& vertex : vertices)
+			{
+				boundsMin = glm::min(boundsMin, vertex.position);
+				boundsMax = glm::max(boundsMax, vertex.position);
+			}
+		}
+
+		auto const center = (boundsMin + boundsMax) * 0.5f;
+		auto const halfExtents = (boundsMax - boundsMin) * 0.5f;
+
+		float extent = std::max(halfExtents.x, std::max(halfExtents.y, halfExtents.z));
+		if (extent <= 0.0f)
+			extent = 1.0f;
+
+		packed.resize(vertices.size());
+
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			auto const& vertex = vertices[i];
+			auto& out = packed[i];
+
+			auto const position = glm::packSnorm4x16(glm::vec4((vertex.position - center) / extent, 0.0f));
+			std::memcpy(out.position, &position, sizeof(out.position));
+
+			out.normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0.0f));
+
+			out.texcoord[0] = glm::packHalf1x16(vertex.texcoord.x);
+			out.texcoord[1] = glm::packHalf1x16(vertex.texcoord.y);
+		}
+
+		auto decode = glm::translate(glm::mat4(1.0f), center);
+		return glm::scale(decode, glm::vec3(extent));
+	}
+}
+
+void ObjModel::createBuffers(VertexFormat format)
 {
 	glGenVertexArrays(1, &mesh.VAO);
 	glGenBuffers(1, &mesh.VBO);
@@ -76,26 +463,345 @@ void ObjModel::createBuffers()
 	glBindVertexArray(mesh.VAO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
-	glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(MeshVertex), mesh.vertices.data(), GL_STATIC_DRAW);
+
+	if (format == VertexFormat::Packed)
+	{
+		std::vector<PackedMeshVertex> packed;
+		mesh.positionDecode = packVertices(mesh.vertices, packed);
+
+		glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedMeshVertex), packed.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		mesh.positionDecode = glm::mat4(1.0f);
+
+		glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(MeshVertex), mesh.vertices.data(), GL_STATIC_DRAW);
+	}
 
 	glGenBuffers(1, &mesh.EBO);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.getIndices().size() * sizeof(uint32_t), mesh.getIndices().data(), GL_STATIC_DRAW);
 
-	// position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
-	glEnableVertexAttribArray(0);
+	mesh.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+	// LOD indices follow the full mesh in the same buffer.
+	size_t const totalIndices = mesh.indices.size() + mesh.lodIndices.size();
+
+	if (mesh.vertices.size() <= 0xffff)
+	{
+		std::vector<uint16_t> shortIndices;
+		shortIndices.reserve(totalIndices);
+		shortIndices.insert(shortIndices.end(), mesh.indices.begin(), mesh.indices.end());
+		shortIndices.insert(shortIndices.end(), mesh.lodIndices.begin(), mesh.lodIndices.end());
+
+		mesh.indexType = GL_UNSIGNED_SHORT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		mesh.indexType = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data());
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t), mesh.lodIndices.size() * sizeof(uint32_t), mesh.lodIndices.data());
+	}
+
+	setVertexAttributes(format);
+}
+
+bool ObjModel::createBuffers(MeshArena& arena)
+{
+	std::vector<PackedMeshVertex> packed;
+	mesh.positionDecode = packVertices(mesh.vertices, packed);
+
+	// LOD indices follow the full mesh, as in the model's own buffers.
+	std::vector<uint32_t> indices;
+	indices.reserve(mesh.indices.size() + mesh.lodIndices.size());
+	indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+	indices.insert(indices.end(), mesh.lodIndices.begin(), mesh.lodIndices.end());
+
+	MeshAllocation allocation;
+	if (!arena.allocate(packed, indices, allocation))
+		return false;
+
+	mesh.VBO = arena.vertexBuffer();
+	mesh.EBO = arena.indexBuffer();
+
+	mesh.indexType = GL_UNSIGNED_INT;
+	mesh.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+	mesh.baseVertex = allocation.baseVertex;
+	mesh.firstIndex = allocation.firstIndex;
+
+	glGenVertexArrays(1, &mesh.VAO);
+	glBindVertexArray(mesh.VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+
+	// The indices are relative to the mesh, so the attributes start at its
+	// first vertex.
+	setVertexAttributes(VertexFormat::Packed, mesh.baseVertex);
+
+	return true;
+}
+
+void setVertexAttributes(VertexFormat format, size_t firstVertex)
+{
+	if (format == VertexFormat::Packed)
+	{
+		size_t const base = firstVertex * sizeof(PackedMeshVertex);
+
+		// Normalized formats hand the shader plain floats, so the shaders
+		// are the same for both layouts.
+		glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedMeshVertex), (void*)(base + offsetof(PackedMeshVertex, position)));
+		glEnableVertexAttribArray(0);
+
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedMeshVertex), (void*)(base + offsetof(PackedMeshVertex, normal)));
+		glEnableVertexAttribArray(1);
+
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedMeshVertex), (void*)(base + offsetof(PackedMeshVertex, texcoord)));
+		glEnableVertexAttribArray(2);
+	}
+	else
+	{
+		size_t const base = firstVertex * sizeof(MeshVertex);
+
+		// position attribute
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)(base + offsetof(MeshVertex, position)));
+		glEnableVertexAttribArray(0);
+
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)(base + offsetof(MeshVertex, normal)));
+		glEnableVertexAttribArray(1);
+
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)(base + offsetof(MeshVertex, texcoord)));
+		glEnableVertexAttribArray(2);
+	}
+}
+
+void ObjModel::setInstances(const std::vector<glm::mat4>& transforms)
+{
+	instanceScratch.resize(transforms.size());
+	for (size_t i = 0; i < transforms.size(); ++i)
+		instanceScratch[i] = { transforms[i] * mesh.positionDecode, glm::vec4(1.0f) };
+
+	uploadInstances();
+}
+
+void ObjModel::setInstances(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& colors)
+{
+	instanceScratch.resize(transforms.size());
+	for (size_t i = 0; i < transforms.size(); ++i)
+		instanceScratch[i] = { transforms[i] * mesh.positionDecode, i < colors.size() ? colors[i] : glm::vec4(1.0f) };
+
+	uploadInstances();
+}
+
+void ObjModel::uploadInstances()
+{
+	auto const size = instanceScratch.size() * sizeof(InstanceData);
+
+	// Box around the placements' bounding spheres, then the sphere around
+	// that box.
+	if (!instanceScratch.empty())
+	{
+		auto const sphere = storedBoundingSphere();
+		float const decodeScale = mesh.positionDecode[0][0];
+
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+		float maxScale = 0.0f;
+
+		for (auto const& instance : instanceScratch)
+		{
+			auto const& model = instance.model;
+			float const scale = std::max(glm::length(glm::vec3(model[0])),
+				std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+			auto const center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+			float const radius = sphere.w * scale;
+
+			boundsMin = glm::min(boundsMin, center - radius);
+			boundsMax = glm::max(boundsMax, center + radius);
+			maxScale = std::max(maxScale, scale);
+		}
+
+		instanceBounds = glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
+		// Without the position decode, which the LOD errors are not in.
+		instanceScale = decodeScale > 0.0f ? maxScale / decodeScale : maxScale;
+	}
+
+	if (instanceStream)
+	{
+		// Storage buffer alignment, as the culler reads the placements
+		// through a buffer range.
+		auto const range = instanceStream->write(instanceScratch.data(), size, StreamBuffer::storageAlignment());
+
+		streamedInstanceBuffer = range.buffer;
+		streamedInstanceOffset = size_t(range.offset);
 
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, normal));
-	glEnableVertexAttribArray(1);
+		if (!culled)
+			bindInstanceAttributes(streamedInstanceBuffer, streamedInstanceOffset);
+	}
+	else
+	{
+		if (instanceVBO == 0)
+		{
+			glGenBuffers(1, &instanceVBO);
+
+			bindInstanceAttributes(instanceVBO);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, size, instanceScratch.data(), GL_STREAM_DRAW);
+	}
+
+	instances = static_cast<uint32_t>(instanceScratch.size());
+
+	if (visibleInstanceVBO != 0)
+		allocateCullingBuffers();
+}
+
+void ObjModel::allocateCullingBuffers()
+{
+	// Placements are re-set every frame (e.g., the swaying trees), so the
+	// buffers are only reallocated when the count outgrows them, and then
+	// with room to spare.
+	if (culledCapacity != 0 && instances <= culledCapacity)
+		return;
+
+	culledCapacity = std::max({ instances, 2 * culledCapacity, 64u });
+
+	// Room for every instance to be visible in either pass; written by the
+	// culler only.
+	glBindBuffer(GL_ARRAY_BUFFER, visibleInstanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, 2 * size_t(culledCapacity) * sizeof(InstanceData), nullptr, GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, occludedInstanceBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (1 + size_t(culledCapacity)) * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+}
+
+void ObjModel::bindInstanceAttributes(uint32_t buffer, size_t offset)
+{
+	glBindVertexArray(mesh.VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	// A mat4 attribute takes four consecutive locations.
+	for (GLuint column = 0; column < 4; ++column)
+	{
+		glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(3 + column);
+		glVertexAttribDivisor(3 + column, 1);
+	}
+
+	glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, color)));
+	glEnableVertexAttribArray(7);
+	glVertexAttribDivisor(7, 1);
+}
+
+void ObjModel::setInstanceCulling(bool enabled)
+{
+	if (enabled == culled || instanceBuffer() == 0)
+		return;
+
+	if (enabled && visibleInstanceVBO == 0)
+	{
+		glGenBuffers(1, &visibleInstanceVBO);
+		glGenBuffers(1, &occludedInstanceBO);
+
+		allocateCullingBuffers();
+
+		glGenBuffers(1, &instanceCommandBO);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceCommandBO);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, 2 * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+	}
+
+	if (enabled)
+	{
+		bindInstanceAttributes(visibleInstanceVBO);
+	}
+	else
+	{
+		bindInstanceAttributes(instanceBuffer(), instanceBufferOffset());
+	}
+
+	culled = enabled;
+}
+
+DrawElementsIndirectCommand ObjModel::instanceCommand(size_t lod) const
+{
+	// The VAO's attributes already start at the mesh's base vertex.
+	DrawElementsIndirectCommand command = MeshArena::command(mesh, lod, 0);
+	command.instanceCount = 0;
+	command.baseVertex = 0;
+
+	return command;
+}
+
+glm::vec4 ObjModel::storedBoundingSphere() const
+{
+	auto const center = glm::vec3(mesh.boundingSphere);
+	float const radius = mesh.boundingSphere.w;
+
+	// The decode is a uniform scale plus a translation.
+	float const scale = mesh.positionDecode[0][0];
+	auto const decodeOffset = glm::vec3(mesh.positionDecode[3]);
 
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, texcoord));
-	glEnableVertexAttribArray(2);
+	return glm::vec4((center - decodeOffset) / scale, radius / scale);
 }
 
-void ObjModel::draw() const
+void ObjModel::drawInstanced(size_t lod) const
 {
+	if (instances == 0)
+		return;
+
 	glBindVertexArray(mesh.VAO);
-	glDrawElements(GL_TRIANGLES, mesh.getIndices().size(), GL_UNSIGNED_INT, 0);
+
+	if (instanceCulling())
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceCommandBO);
+		glDrawElementsIndirect(GL_TRIANGLES, mesh.indexType, nullptr);
+		return;
+	}
+
+	size_t const indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	uint32_t count = mesh.indexCount;
+	size_t offset = mesh.firstIndex * indexSize;
+
+	if (lod != 0 && lod < mesh.lods.size())
+	{
+		count = mesh.lods[lod].indexCount;
+		offset += mesh.lods[lod].indexOffset * indexSize;
+	}
+
+	glDrawElementsInstanced(GL_TRIANGLES, count, mesh.indexType, (void*)offset, instances);
+}
+
+void ObjModel::drawDisoccludedInstances() const
+{
+	if (instances == 0 || !instanceCulling())
+		return;
+
+	glBindVertexArray(mesh.VAO);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceCommandBO);
+	glDrawElementsIndirect(GL_TRIANGLES, mesh.indexType, (void*)sizeof(DrawElementsIndirectCommand));
+}
+
+void ObjModel::draw(size_t lod) const
+{
+	glBindVertexArray(mesh.VAO);
+
+	size_t const indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	size_t const offset = mesh.firstIndex * indexSize;
+
+	if (lod == 0 || lod >= mesh.lods.size())
+	{
+		glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)offset);
+		return;
+	}
+
+	auto const& level = mesh.lods[lod];
+
+	glDrawElements(GL_TRIANGLES, level.indexCount, mesh.indexType, (void*)(offset + level.indexOffset * indexSize));
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include <vector>
+
+#include <cstdint>
 
 #include "glm.hpp"
 
@@ -22,6 +25,36 @@ struct MeshVertex
 	glm::vec2 texcoord{ 0.0f, 0.0f };
 };
 
+// GPU-side vertex layout used by VertexFormat::Packed (16 bytes instead of 32):
+//	- position: snorm16 x3 relative to the mesh bounds, w unused;
+//	- normal: snorm 10:10:10:2;
+//	- texcoord: half x2.
+struct PackedMeshVertex
+{
+	int16_t position[4];
+	uint32_t normal;
+	uint16_t texcoord[2];
+};
+
+static_assert(sizeof(PackedMeshVertex) == 16, "PackedMeshVertex must stay tightly packed");
+
+enum class VertexFormat
+{
+	// MeshVertex as is.
+	Float,
+	// PackedMeshVertex. Positions come out of the vertex shader in [-1, 1]
+	// and must be mapped back through ObjModel::decodeMatrix().
+	Packed
+};
+
+// Points attributes 0-2 of the bound VAO at vertices of the given format in
+// the bound GL_ARRAY_BUFFER, starting at firstVertex.
+void setVertexAttributes(VertexFormat format, size_t firstVertex = 0);
+
+class MeshArena;
+class StreamBuffer;
+struct DrawElementsIndirectCommand;
+
 namespace std {
 	template<> struct hash<MeshVertex> {
 		size_t operator()(MeshVertex const& vertex) const {
@@ -32,6 +65,17 @@ namespace std {
 	};
 }
 
+// A level of detail within the mesh's element buffer. LOD 0 is the full
+// mesh; coarser levels index the same vertices.
+struct MeshLod
+{
+	// In indices, from the start of the element buffer.
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	// Largest geometric deviation from the full mesh, in model space units.
+	float error;
+};
+
 struct ObjMesh
 {
 	void addVertex(const MeshVertex& vertex) { vertices.emplace_back(vertex); }
@@ -40,22 +84,191 @@ struct ObjMesh
 	const std::vector<MeshVertex>& getVertices() const { return vertices; }
 	const std::vector<uint32_t>& getIndices() const { return indices; }
 
+	void computeBounds();
+
 	uint32_t VAO;
 	uint32_t VBO;
 	uint32_t EBO;
 
+	// What createBuffers() uploaded: GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	// indices, and the transform from stored to model space positions.
+	uint32_t indexType = 0;
+	uint32_t indexCount = 0;
+	glm::mat4 positionDecode{ 1.0f };
+
+	// Where createBuffers(MeshArena&) placed the mesh in the arena's buffers
+	// (VBO and EBO are then the arena's). Zero for meshes with buffers of
+	// their own.
+	uint32_t baseVertex = 0;
+	uint32_t firstIndex = 0;
+
 	std::vector<MeshVertex> vertices;
 	std::vector<uint32_t> indices;
+
+	// Filled by ObjModel::generateLods(). The element buffer holds indices
+	// followed by lodIndices; lods is empty if no LODs were generated.
+	std::vector<uint32_t> lodIndices;
+	std::vector<MeshLod> lods;
+
+	// Model space bounds from computeBounds(): the AABB and a sphere around
+	// its center (xyz) that encloses every vertex (radius in w).
+	glm::vec3 boundsMin{ 0.0f, 0.0f, 0.0f };
+	glm::vec3 boundsMax{ 0.0f, 0.0f, 0.0f };
+	glm::vec4 boundingSphere{ 0.0f, 0.0f, 0.0f, 0.0f };
+};
+
+enum class ObjParser
+{
+	// tinyobjloader: single-threaded, streams the file through an ifstream.
+	TinyObj,
+	// rapidobj: memory-maps the file and parses line-aligned chunks on all
+	// cores.
+	RapidObj
+};
+
+struct ObjLoadOptions
+{
+	ObjParser parser = ObjParser::RapidObj;
+	bool useMeshCache = true;
+	// Reorder indices and vertices for the post-transform cache, overdraw and
+	// vertex fetch (see mesh_optimizer.hpp). The result is what gets cached.
+	bool optimize = true;
+	// Build simplified LODs (see ObjModel::generateLods()).
+	bool generateLods = true;
+
+	// Process-wide defaults. These can be overridden without recompiling via
+	// the OBJ_PARSER ("tinyobj" or "rapidobj"), OBJ_MESH_CACHE, OBJ_OPTIMIZE
+	// and OBJ_LODS ("0" or "1") environment variables, e.g. to benchmark both
+	// parsers against each other.
+	static const ObjLoadOptions& defaults();
 };
 
 class ObjModel
 {
 public:
-	bool load(const std::string& path);
+	bool load(const std::string& path, const ObjLoadOptions& options = ObjLoadOptions::defaults());
+
+	// Simplifies the mesh into successively halved LODs until the
+	// simplifier stops making progress. Requires up to date bounds.
+	void generateLods();
+
+	// Picks the coarsest LOD whose error, projected to the screen for an
+	// object drawn with the given model matrix, stays below pixelError.
+	size_t selectLod(const glm::mat4& model, const glm::vec3& cameraPosition, const glm::mat4& projection,
+		float viewportHeight, float pixelError) const;
+
+	// The same for every placement of drawInstanced() at once, from the
+	// sphere that bounds them all: the LOD is the one needed by a placement
+	// at the nearest point of that sphere, so none gets less detail than
+	// selectLod() would give it on its own.
+	size_t selectInstancedLod(const glm::vec3& cameraPosition, const glm::mat4& projection,
+		float viewportHeight, float pixelError) const;
+
+	// Indices are stored as 16 bit whenever the mesh has fewer than 65536
+	// vertices, regardless of the vertex format.
+	void createBuffers(VertexFormat format = VertexFormat::Packed);
+
+	// Suballocates the mesh (packed, 32-bit indices) from a shared arena
+	// instead. The model still gets a VAO of its own, pointing into the
+	// arena, for draw() and the per-instance attributes of drawInstanced().
+	// Returns false if the arena is full.
+	bool createBuffers(MeshArena& arena);
+
+	// Has to be folded into the model matrix (model * decodeMatrix()) for
+	// meshes uploaded with VertexFormat::Packed; identity otherwise.
+	const glm::mat4& decodeMatrix() const { return mesh.positionDecode; }
+
+	void draw(size_t lod = 0) const;
+
+	// Placements for drawInstanced(), as model matrices (the position decode
+	// is applied here) and optional per-instance colors (white otherwise).
+	// Uploaded to a per-instance buffer that feeds vertex attributes 3-6
+	// (mat4) and 7 (vec4 color). Requires createBuffers().
+	void setInstances(const std::vector<glm::mat4>& transforms);
+	void setInstances(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& colors);
+
+	uint32_t instanceCount() const { return instances; }
+
+	// Writes the placements of each setInstances() to this frame's part of
+	// the stream instead of re-specifying a buffer of the model's own, for
+	// placements that change every frame. Call before the first
+	// setInstances(); the stream must outlive the model.
+	void setInstanceStream(StreamBuffer* stream) { instanceStream = stream; }
+
+	// Draws every placement with one glDrawElementsInstanced. With instance
+	// culling enabled, draws the placements that survived the last
+	// InstanceCuller::cull() instead, with one glDrawElementsIndirect (the
+	// LOD is then the one that was culled for).
+	void drawInstanced(size_t lod = 0) const;
 
-	void createBuffers();
+	// Draws the placements that InstanceCuller::cullDisoccluded() found
+	// visible after all (second indirect command).
+	void drawDisoccludedInstances() const;
 
-	void draw() const;
+	// GPU instance culling (see gpu_culling.hpp). While enabled, the
+	// per-instance attributes read from a second buffer that the culler
+	// fills with the visible placements, and the instance count comes from
+	// indirect commands that it writes.
+	void setInstanceCulling(bool enabled);
+	bool instanceCulling() const { return visibleInstanceVBO != 0 && culled; }
+
+	// The placements are the instanceCount() elements at instanceBufferOffset().
+	uint32_t instanceBuffer() const { return instanceStream ? streamedInstanceBuffer : instanceVBO; }
+	size_t instanceBufferOffset() const { return instanceStream ? streamedInstanceOffset : 0; }
+	size_t instanceBufferSize() const { return size_t(instances) * sizeof(InstanceData); }
+	// Room for two sets of instances: the early culling pass writes from
+	// the start, the disoccluded pass from instanceCount() on.
+	uint32_t visibleInstanceBuffer() const { return visibleInstanceVBO; }
+	// Two DrawElementsIndirectCommands, one per pass.
+	uint32_t instanceCommandBuffer() const { return instanceCommandBO; }
+	// A count followed by the indices of the instances that the early pass
+	// rejected as occluded.
+	uint32_t occludedInstanceBuffer() const { return occludedInstanceBO; }
+
+	// Command for drawing the given LOD through the model's own VAO, with
+	// no instances yet.
+	DrawElementsIndirectCommand instanceCommand(size_t lod) const;
+
+	// Bounding sphere of the stored positions, i.e. in the space that the
+	// instance matrices (which include the position decode) map from.
+	glm::vec4 storedBoundingSphere() const;
 
 	ObjMesh mesh;
+
+private:
+	struct InstanceData
+	{
+		glm::mat4 model;
+		glm::vec4 color;
+	};
+
+	void uploadInstances();
+	void bindInstanceAttributes(uint32_t buffer, size_t offset = 0);
+	void allocateCullingBuffers();
+
+	// World space center and radius; scale is the largest axis scale of the
+	// model matrix.
+	size_t selectLod(const glm::vec3& center, float radius, float scale, const glm::vec3& cameraPosition,
+		const glm::mat4& projection, float viewportHeight, float pixelError) const;
+
+	uint32_t instanceVBO = 0;
+	uint32_t instances = 0;
+
+	StreamBuffer* instanceStream = nullptr;
+	uint32_t streamedInstanceBuffer = 0;
+	size_t streamedInstanceOffset = 0;
+
+	// World space sphere around every placement, and the largest axis scale
+	// among their model matrices; for selectInstancedLod().
+	glm::vec4 instanceBounds{ 0.0f };
+	float instanceScale = 1.0f;
+
+	uint32_t visibleInstanceVBO = 0;
+	uint32_t instanceCommandBO = 0;
+	uint32_t occludedInstanceBO = 0;
+	// Instances the two buffers above have room for.
+	uint32_t culledCapacity = 0;
+	bool culled = false;
+
+	std::vector<InstanceData> instanceScratch;
 };
\ No newline at end of file
@@ -0,0 +1,422 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#	include <io.h>
+#else
+#	include <unistd.h>
+#endif
+
+namespace
+{
+	// The original stdout, once reserveStdout() has pointed stdout itself
+	// at stderr.
+	std::FILE* reportStream = nullptr;
+
+	// Animation step per frame, so that runs are reproducible.
+	constexpr float kFrameStep = 1.0f / 60.0f;
+
+	struct CameraKey
+	{
+		glm::vec3 position;
+		glm::vec3 target;
+	};
+
+	// A closed loop around the farm: wide views of the whole scene, and low
+	// passes past the house, the trees and the table, where most of the
+	// draws are.
+	const CameraKey kCameraPath[] = {
+		{ {    0.0f, 30.0f,  100.0f }, {   0.0f, 5.0f,   0.0f } },
+		{ {   90.0f, 20.0f,   60.0f }, {   0.0f, 5.0f,   0.0f } },
+		{ {  100.0f, 12.0f,  -40.0f }, {   0.0f, 8.0f,   0.0f } },
+		{ {   20.0f,  6.0f,  -90.0f }, { -10.0f, 5.0f,   0.0f } },
+		{ {  -70.0f, 15.0f,  -70.0f }, {   0.0f, 5.0f,   0.0f } },
+		{ { -100.0f, 35.0f,   20.0f }, {   0.0f, 0.0f,   0.0f } },
+		{ {  -40.0f,  8.0f,   50.0f }, {  10.0f, 5.0f, -10.0f } }
+	};
+
+	constexpr size_t kCameraKeyCount = sizeof(kCameraPath) / sizeof(kCameraPath[0]);
+
+	glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+	{
+		float const t2 = t * t;
+		float const t3 = t2 * t;
+
+		return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+	}
+
+	// position in [0, 1) around the loop.
+	Camera cameraOnPath(float position)
+	{
+		float const scaled = position * kCameraKeyCount;
+		auto const segment = static_cast<size_t>(scaled) % kCameraKeyCount;
+		float const t = scaled - std::floor(scaled);
+
+		auto const& k0 = kCameraPath[(segment + kCameraKeyCount - 1) % kCameraKeyCount];
+		auto const& k1 = kCameraPath[segment];
+		auto const& k2 = kCameraPath[(segment + 1) % kCameraKeyCount];
+		auto const& k3 = kCameraPath[(segment + 2) % kCameraKeyCount];
+
+		auto const eye = catmullRom(k0.position, k1.position, k2.position, k3.position, t);
+		auto const target = catmullRom(k0.target, k1.target, k2.target, k3.target, t);
+		auto const front = glm::normalize(target - eye);
+
+		float const yaw = glm::degrees(std::atan2(front.z, front.x));
+		float const pitch = glm::degrees(std::asin(glm::clamp(front.y, -1.0f, 1.0f)));
+
+		return Camera(eye, glm::vec3(0.0f, 1.0f, 0.0f), yaw, pitch);
+	}
+
+	// Nearest rank.
+	float percentile(const std::vector<float>& sorted, float p)
+	{
+		if (sorted.empty())
+			return 0.0f;
+
+		auto const rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+		return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+	}
+
+	void writeJsonString(std::FILE* file, const char* string)
+	{
+		std::fputc('"', file);
+
+		for (auto ptr = string ? string : ""; *ptr; ++ptr)
+		{
+			auto const ch = static_cast<unsigned char>(*ptr);
+
+			if ('"' == ch || '\\' == ch)
+				std::fprintf(file, "\\%c", ch);
+			else if (ch < 0x20)
+				std::fprintf(file, "\\u%04x", ch);
+			else
+				std::fputc(ch, file);
+		}
+
+		std::fputc('"', file);
+	}
+}
+
+bool BenchmarkOptions::parse(int argc, char* argv[], BenchmarkOptions& options)
+{
+	bool enabled = false;
+
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		const char* const value = argv[i + 1];
+
+		if (0 == std::strcmp(argv[i], "--benchmark"))
+		{
+			options.frames = static_cast<unsigned>(std::max(1ul, std::strtoul(value, nullptr, 10)));
+			enabled = true;
+		}
+		else if (0 == std::strcmp(argv[i], "--benchmark-warmup"))
+		{
+			options.warmupFrames = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+		}
+		else if (0 == std::strcmp(argv[i], "--benchmark-size"))
+		{
+			int width = 0, height = 0;
+			if (2 == std::sscanf(value, "%dx%d", &width, &height) && width > 0 && height > 0)
+			{
+				options.width = width;
+				options.height = height;
+			}
+			else
+			{
+				std::fprintf(stderr, "Invalid benchmark size '%s', expected WxH\n", value);
+			}
+		}
+		else if (0 == std::strcmp(argv[i], "--benchmark-context"))
+		{
+			if (0 == std::strcmp(value, "native"))
+				options.contextApi = WindowOptions::ContextApi::Native;
+			else if (0 == std::strcmp(value, "egl"))
+				options.contextApi = WindowOptions::ContextApi::EGL;
+			else if (0 == std::strcmp(value, "osmesa"))
+				options.contextApi = WindowOptions::ContextApi::OSMesa;
+			else
+				std::fprintf(stderr, "Unknown context API '%s'\n", value);
+		}
+		else if (0 == std::strcmp(argv[i], "--benchmark-out"))
+		{
+			options.reportPath = value;
+		}
+	}
+
+	return enabled;
+}
+
+WindowOptions BenchmarkOptions::windowOptions() const
+{
+	WindowOptions window;
+	window.visible = false;
+	window.contextApi = contextApi;
+	return window;
+}
+
+Benchmark::Benchmark(const BenchmarkOptions& options)
+	: mOptions(options)
+{
+}
+
+Benchmark::~Benchmark()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteRenderbuffers(1, &mColorBuffer);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+}
+
+int Benchmark::run(OpenGLRenderer& renderer)
+{
+	OGL_TRACE_SCOPE("benchmark");
+
+	createTarget();
+
+	renderer.windowWidth = mOptions.width;
+	renderer.windowHeight = mOptions.height;
+	glViewport(0, 0, mOptions.width, mOptions.height);
+
+	auto present = renderer.framePacer.options();
+	present.mode = PresentMode::Uncapped;
+	renderer.framePacer.configure(present);
+
+	GpuProfiler::instance().setEnabled(true);
+
+	std::printf("Benchmark: %u frames (after %u warm-up) at %dx%d on %s\n",
+		mOptions.frames, mOptions.warmupFrames, mOptions.width, mOptions.height, glGetString(GL_RENDERER));
+
+	// The warm-up flies the start of the path too.
+	for (unsigned i = 0; i < mOptions.warmupFrames; ++i)
+		drawFrame(renderer, i % mOptions.frames, mOptions.frames);
+
+	std::vector<float> frameTimes;
+	frameTimes.reserve(mOptions.frames);
+
+	mFirstMeasuredFrame = GpuProfiler::instance().frameNumber();
+
+	auto previous = Clock::now();
+
+	for (unsigned i = 0; i < mOptions.frames; ++i)
+	{
+		drawFrame(renderer, i, mOptions.frames);
+		accumulatePasses();
+
+		auto const now = Clock::now();
+		frameTimes.push_back(std::chrono::duration<float, std::milli>(now - previous).count());
+		previous = now;
+	}
+
+	// The results of the last frames are still in flight; once the GPU is
+	// idle, empty frames collect them all.
+	glFinish();
+
+	for (unsigned i = 0; i < GpuProfiler::kFrameLatency; ++i)
+	{
+		GpuProfiler::instance().endFrame();
+		accumulatePasses();
+	}
+
+	return writeReport(frameTimes, renderer.renderStats) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void Benchmark::createTarget()
+{
+	glGenRenderbuffers(1, &mColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, mOptions.width, mOptions.height);
+
+	// Same depth format as the window's (see startUp()), which the Hi-Z
+	// pyramid is copied from.
+	glGenRenderbuffers(1, &mDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mOptions.width, mOptions.height);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+
+	auto const status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (GL_FRAMEBUFFER_COMPLETE != status)
+		throw Error("Benchmark framebuffer incomplete (0x%x)", status);
+
+	// Stays bound for the whole run; nothing else binds framebuffers.
+	OGL_CHECKPOINT_ALWAYS();
+}
+
+void Benchmark::drawFrame(OpenGLRenderer& renderer, unsigned frame, unsigned frameCount)
+{
+	OGL_TRACE_SCOPE("frame");
+
+	renderer.framePacer.beginFrame();
+
+	glfwPollEvents();
+
+	renderer.updateTextureStreaming();
+
+	renderer.camera = cameraOnPath(static_cast<float>(frame) / frameCount);
+
+	renderer.updateSimulation(kFrameStep);
+
+	renderer.updateUniforms();
+
+	renderer.drawScene();
+
+	renderer.framePacer.endFrame();
+
+	GpuProfiler::instance().endFrame();
+}
+
+void Benchmark::accumulatePasses()
+{
+	auto const& profiler = GpuProfiler::instance();
+
+	// Each measured frame once: results can be kept over from an earlier
+	// frame, and the first ones collected are from the warm-up.
+	auto const frame = profiler.resultsFrame();
+	if (frame < mFirstMeasuredFrame || frame == mAccumulatedFrame)
+		return;
+
+	mAccumulatedFrame = frame;
+
+	for (auto const& result : profiler.results())
+	{
+		auto pass = std::find_if(mPasses.begin(), mPasses.end(), [&result](const PassTotal& total) {
+			return 0 == std::strcmp(total.name, result.name);
+		});
+
+		if (pass == mPasses.end())
+		{
+			mPasses.push_back(PassTotal{ result.name });
+			pass = mPasses.end() - 1;
+		}
+
+		if (result.gpuMs >= 0.0f)
+		{
+			pass->gpuMs += result.gpuMs;
+			++pass->gpuSamples;
+		}
+
+		pass->cpuMs += result.cpuMs;
+		++pass->samples;
+	}
+}
+
+void BenchmarkOptions::reserveStdout() const
+{
+	if (!reportPath.empty() || reportStream)
+		return;
+
+	std::fflush(stdout);
+
+#	if defined(_WIN32)
+	int const report = _dup(_fileno(stdout));
+	if (report < 0 || !(reportStream = _fdopen(report, "wb")))
+		return;
+
+	_dup2(_fileno(stderr), _fileno(stdout));
+#	else
+	int const report = dup(fileno(stdout));
+	if (report < 0 || !(reportStream = fdopen(report, "wb")))
+		return;
+
+	dup2(fileno(stderr), fileno(stdout));
+#	endif
+}
+
+bool Benchmark::writeReport(const std::vector<float>& frameTimes, const RenderQueueStats& stats) const
+{
+	auto sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (auto time : sorted)
+		sum += time;
+
+	double const mean = sorted.empty() ? 0.0 : sum / sorted.size();
+
+	std::FILE* file = reportStream ? reportStream : stdout;
+	if (!mOptions.reportPath.empty())
+	{
+		file = std::fopen(mOptions.reportPath.c_str(), "wb");
+		if (!file)
+		{
+			std::fprintf(stderr, "Cannot write benchmark report '%s'\n", mOptions.reportPath.c_str());
+			return false;
+		}
+	}
+
+	std::fprintf(file, "{\n");
+
+	std::fprintf(file, "  \"renderer\": ");
+	writeJsonString(file, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+	std::fprintf(file, ",\n  \"version\": ");
+	writeJsonString(file, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+	std::fprintf(file, ",\n");
+
+	std::fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n", mOptions.width, mOptions.height);
+	std::fprintf(file, "  \"frames\": %zu,\n  \"warmup_frames\": %u,\n", frameTimes.size(), mOptions.warmupFrames);
+
+	std::fprintf(file, "  \"frame_ms\": {\n");
+	std::fprintf(file, "    \"mean\": %.4f,\n", mean);
+	std::fprintf(file, "    \"p50\": %.4f,\n", percentile(sorted, 0.50f));
+	std::fprintf(file, "    \"p95\": %.4f,\n", percentile(sorted, 0.95f));
+	std::fprintf(file, "    \"p99\": %.4f,\n", percentile(sorted, 0.99f));
+	std::fprintf(file, "    \"max\": %.4f\n", sorted.empty() ? 0.0f : sorted.back());
+	std::fprintf(file, "  },\n");
+
+	std::fprintf(file, "  \"fps\": %.2f,\n", mean > 0.0 ? 1000.0 / mean : 0.0);
+
+	// Means over the frames that reported each pass; gpu_ms is null for
+	// passes only timed on the CPU.
+	std::fprintf(file, "  \"passes\": [");
+	for (size_t i = 0; i < mPasses.size(); ++i)
+	{
+		auto const& pass = mPasses[i];
+
+		std::fprintf(file, "%s\n    { \"name\": ", i ? "," : "");
+		writeJsonString(file, pass.name);
+
+		if (pass.gpuSamples)
+			std::fprintf(file, ", \"gpu_ms\": %.4f", pass.gpuMs / pass.gpuSamples);
+		else
+			std::fprintf(file, ", \"gpu_ms\": null");
+
+		std::fprintf(file, ", \"cpu_ms\": %.4f }", pass.samples ? pass.cpuMs / pass.samples : 0.0);
+	}
+	std::fprintf(file, "%s],\n", mPasses.empty() ? "" : "\n  ");
+
+	std::fprintf(file, "  \"last_frame\": {\n");
+	std::fprintf(file, "    \"draw_calls\": %u,\n", stats.drawCalls);
+	std::fprintf(file, "    \"triangles\": %llu,\n", static_cast<unsigned long long>(stats.triangles));
+	std::fprintf(file, "    \"program_changes\": %u,\n", stats.programChanges);
+	std::fprintf(file, "    \"texture_binds\": %u\n", stats.textureBinds);
+	std::fprintf(file, "  }\n");
+
+	std::fprintf(file, "}\n");
+
+	bool ok = 0 == std::ferror(file);
+
+	if (!mOptions.reportPath.empty())
+	{
+		ok = (0 == std::fclose(file)) && ok;
+
+		if (ok)
+			std::printf("Benchmark: mean %.2f ms, p99 %.2f ms; report written to '%s'\n", mean, percentile(sorted, 0.99f), mOptions.reportPath.c_str());
+	}
+	else
+	{
+		ok = (0 == std::fflush(file)) && ok;
+	}
+
+	return ok;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+struct BenchmarkOptions
+{
+	// Measured frames, after warmupFrames that are drawn but not measured
+	// (texture streaming, shader and buffer warm-up).
+	unsigned frames = 1000;
+	unsigned warmupFrames = 120;
+
+	// Size of the offscreen framebuffer.
+	int width = 1920;
+	int height = 1080;
+
+	WindowOptions::ContextApi contextApi = WindowOptions::ContextApi::Native;
+
+	// Where the JSON report goes; stdout if empty (see reserveStdout()).
+	std::string reportPath;
+
+	// Parses
+	//
+	//	--benchmark N              enables the benchmark, N measured frames
+	//	--benchmark-warmup N
+	//	--benchmark-size WxH
+	//	--benchmark-context native|egl|osmesa
+	//	--benchmark-out report.json
+	//
+	// Returns false if --benchmark is not among the arguments.
+	static bool parse(int argc, char* argv[], BenchmarkOptions& options);
+
+	// Without a reportPath, keeps stdout for the report alone, so that it
+	// parses as JSON: all other output (printf, std::cout) goes to stderr
+	// from then on. Call before anything is logged.
+	void reserveStdout() const;
+
+	// Hidden window, with the requested context API.
+	WindowOptions windowOptions() const;
+};
+
+// Unattended performance run: draws the scene into an offscreen framebuffer
+// while flying the camera along a fixed path, then writes a JSON report with
+// frame time statistics (mean, p50, p95, p99, max) and the mean per-pass
+// times from GpuProfiler.
+//
+// Camera and animation advance by frame, not by time, so every run draws the
+// same frames whatever the machine; with --benchmark-context osmesa it also
+// runs on hosts without a GPU or display server, using Mesa's software
+// rasterizer.
+//
+// Presentation is uncapped and nothing is swapped; the frames in flight are
+// still limited by the FramePacer, so a frame's time includes waiting for
+// the GPU to catch up.
+class Benchmark
+{
+public:
+	explicit Benchmark(const BenchmarkOptions& options);
+	~Benchmark();
+
+	Benchmark(const Benchmark&) = delete;
+	Benchmark& operator=(const Benchmark&) = delete;
+
+	// Call after the renderer's resources are loaded. Returns the exit code.
+	int run(OpenGLRenderer& renderer);
+
+private:
+	struct PassTotal
+	{
+		const char* name;
+		double gpuMs = 0.0;
+		double cpuMs = 0.0;
+		unsigned gpuSamples = 0;
+		unsigned samples = 0;
+	};
+
+	void createTarget();
+	void drawFrame(OpenGLRenderer& renderer, unsigned frame, unsigned frameCount);
+	void accumulatePasses();
+	bool writeReport(const std::vector<float>& frameTimes, const RenderQueueStats& stats) const;
+
+	BenchmarkOptions mOptions;
+
+	GLuint mFramebuffer = 0;
+	GLuint mColorBuffer = 0;
+	GLuint mDepthBuffer = 0;
+
+	std::vector<PassTotal> mPasses;
+
+	// Profiler frames (see GpuProfiler::frameNumber()): the first measured
+	// one, and the one whose results were accumulated last.
+	uint64_t mFirstMeasuredFrame = 0;
+	uint64_t mAccumulatedFrame = 0;
+};
@@ -0,0 +1,241 @@
+#include "block_compression.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	void fetchBlock(const unsigned char* rgba, int width, int height, int bx, int by, unsigned char block[16][4])
+	{
+		for (int y = 0; y < 4; ++y)
+		{
+			int const sy = std::min(by * 4 + y, height - 1);
+
+			for (int x = 0; x < 4; ++x)
+			{
+				int const sx = std::min(bx * 4 + x, width - 1);
+				std::memcpy(block[y * 4 + x], rgba + (size_t(sy) * width + sx) * 4, 4);
+			}
+		}
+	}
+
+	uint16_t packRGB565(const float c[3])
+	{
+		auto const r = static_cast<uint16_t>(std::lround(std::clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f));
+		auto const g = static_cast<uint16_t>(std::lround(std::clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f));
+		auto const b = static_cast<uint16_t>(std::lround(std::clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f));
+		return uint16_t((r << 11) | (g << 5) | b);
+	}
+
+	void unpackRGB565(uint16_t c, int out[3])
+	{
+		int const r = (c >> 11) & 31;
+		int const g = (c >> 5) & 63;
+		int const b = c & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	void writeColorBlock(const unsigned char block[16][4], unsigned char* out)
+	{
+		// Mean and covariance of the block's colours.
+		float mean[3] = {};
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < 3; ++c)
+				mean[c] += block[i][c];
+		for (float& m : mean)
+			m /= 16.0f;
+
+		float cov[6] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			float const r = block[i][0] - mean[0];
+			float const g = block[i][1] - mean[1];
+			float const b = block[i][2] - mean[2];
+			cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+			cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+		}
+
+		// Principal axis by power iteration.
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iter = 0; iter < 8; ++iter)
+		{
+			float const x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+			float const y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+			float const z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+
+			float const len = std::max({ std::fabs(x), std::fabs(y), std::fabs(z) });
+			if (len < 1e-6f)
+				break;
+
+			axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+		}
+
+		// Endpoints: the extreme projections onto the axis.
+		float minProj = 1e30f, maxProj = -1e30f;
+		int minIndex = 0, maxIndex = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			float const p = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+			if (p < minProj) { minProj = p; minIndex = i; }
+			if (p > maxProj) { maxProj = p; maxIndex = i; }
+		}
+
+		float const hi[3] = { float(block[maxIndex][0]), float(block[maxIndex][1]), float(block[maxIndex][2]) };
+		float const lo[3] = { float(block[minIndex][0]), float(block[minIndex][1]), float(block[minIndex][2]) };
+
+		uint16_t c0 = packRGB565(hi);
+		uint16_t c1 = packRGB565(lo);
+
+		// c0 > c1 selects the four-colour mode; equal endpoints encode a
+		// solid block (all indices 0).
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		uint32_t indices = 0;
+
+		if (c0 != c1)
+		{
+			int e0[3], e1[3];
+			unpackRGB565(c0, e0);
+			unpackRGB565(c1, e1);
+
+			int palette[4][3];
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[0][c] = e0[c];
+				palette[1][c] = e1[c];
+				palette[2][c] = (2 * e0[c] + e1[c]) / 3;
+				palette[3][c] = (e0[c] + 2 * e1[c]) / 3;
+			}
+
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 0, bestDist = 1 << 30;
+				for (int p = 0; p < 4; ++p)
+				{
+					int const dr = block[i][0] - palette[p][0];
+					int const dg = block[i][1] - palette[p][1];
+					int const db = block[i][2] - palette[p][2];
+					int const dist = dr * dr + dg * dg + db * db;
+					if (dist < bestDist) { bestDist = dist; best = p; }
+				}
+				indices |= uint32_t(best) << (2 * i);
+			}
+		}
+
+		out[0] = uint8_t(c0); out[1] = uint8_t(c0 >> 8);
+		out[2] = uint8_t(c1); out[3] = uint8_t(c1 >> 8);
+		out[4] = uint8_t(indices); out[5] = uint8_t(indices >> 8);
+		out[6] = uint8_t(indices >> 16); out[7] = uint8_t(indices >> 24);
+	}
+
+	void writeAlphaBlock(const unsigned char block[16][4], unsigned char* out)
+	{
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; ++i)
+		{
+			a0 = std::max<int>(a0, block[i][3]);
+			a1 = std::min<int>(a1, block[i][3]);
+		}
+
+		out[0] = uint8_t(a0);
+		out[1] = uint8_t(a1);
+
+		uint64_t indices = 0;
+
+		if (a0 != a1)
+		{
+			// a0 > a1: eight-value mode, palette runs from a0 (index 0) to a1
+			// (index 1) with six interpolated values (indices 2-7).
+			int palette[8] = { a0, a1 };
+			for (int p = 1; p < 7; ++p)
+				palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 0, bestDist = 1 << 30;
+				for (int p = 0; p < 8; ++p)
+				{
+					int const dist = std::abs(block[i][3] - palette[p]);
+					if (dist < bestDist) { bestDist = dist; best = p; }
+				}
+				indices |= uint64_t(best) << (3 * i);
+			}
+		}
+
+		for (int b = 0; b < 6; ++b)
+			out[2 + b] = uint8_t(indices >> (8 * b));
+	}
+
+	template< typename tEncode >
+	void encodeBlocks(const unsigned char* rgba, int width, int height, size_t blockSize, std::vector<unsigned char>& out, tEncode&& encode)
+	{
+		int const blocksX = (width + 3) / 4;
+		int const blocksY = (height + 3) / 4;
+
+		auto const base = out.size();
+		out.resize(base + size_t(blocksX) * blocksY * blockSize);
+
+		unsigned char block[16][4];
+		for (int by = 0; by < blocksY; ++by)
+		{
+			for (int bx = 0; bx < blocksX; ++bx)
+			{
+				fetchBlock(rgba, width, height, bx, by, block);
+				encode(block, out.data() + base + (size_t(by) * blocksX + bx) * blockSize);
+			}
+		}
+	}
+}
+
+void encodeBC1(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out)
+{
+	encodeBlocks(rgba, width, height, 8, out, [](const unsigned char block[16][4], unsigned char* dst) {
+		writeColorBlock(block, dst);
+	});
+}
+
+void encodeBC3(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out)
+{
+	encodeBlocks(rgba, width, height, 16, out, [](const unsigned char block[16][4], unsigned char* dst) {
+		writeAlphaBlock(block, dst);
+		writeColorBlock(block, dst + 8);
+	});
+}
+
+size_t blockCompressedSize(int width, int height, bool hasAlpha)
+{
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * (hasAlpha ? 16 : 8);
+}
+
+void downsampleRGBA(const unsigned char* src, int width, int height, std::vector<unsigned char>& dst)
+{
+	int const dstWidth = std::max(1, width / 2);
+	int const dstHeight = std::max(1, height / 2);
+
+	dst.resize(size_t(dstWidth) * dstHeight * 4);
+
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		int const y0 = std::min(2 * y, height - 1);
+		int const y1 = std::min(2 * y + 1, height - 1);
+
+		for (int x = 0; x < dstWidth; ++x)
+		{
+			int const x0 = std::min(2 * x, width - 1);
+			int const x1 = std::min(2 * x + 1, width - 1);
+
+			for (int c = 0; c < 4; ++c)
+			{
+				int const sum =
+					src[(size_t(y0) * width + x0) * 4 + c] + src[(size_t(y0) * width + x1) * 4 + c] +
+					src[(size_t(y1) * width + x0) * 4 + c] + src[(size_t(y1) * width + x1) * 4 + c];
+
+				dst[(size_t(y) * dstWidth + x) * 4 + c] = uint8_t((sum + 2) / 4);
+			}
+		}
+	}
+}
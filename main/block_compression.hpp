@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// CPU encoders for the S3TC block formats.
+//
+// Both take tightly packed RGBA8 pixels (width x height) and write one block
+// per 4x4 texel tile, row by row; edge tiles are padded by clamping. BC1
+// stores 8 bytes per block (RGB, 4 bpp), BC3 stores 16 bytes per block (RGB
+// plus interpolated alpha, 8 bpp).
+//
+// The colour endpoints are chosen along the principal axis of each block's
+// colours, which is close to what offline encoders get for typical albedo
+// textures at a fraction of the cost.
+void encodeBC1(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out);
+void encodeBC3(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out);
+
+size_t blockCompressedSize(int width, int height, bool hasAlpha);
+
+// Halves an RGBA8 image with a 2x2 box filter (odd edges are clamped).
+void downsampleRGBA(const unsigned char* src, int width, int height, std::vector<unsigned char>& dst);
@@ -5,6 +5,8 @@
 
 #include "glm.hpp"
 
+#include "frustum.hpp"
+
 #include <vector>
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -69,6 +71,12 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // returns the world space frustum planes of the view through the given projection
+    Frustum GetFrustum(const glm::mat4& projection)
+    {
+        return Frustum::fromMatrix(projection * GetViewMatrix());
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
@@ -0,0 +1,87 @@
+#include "dog.hpp"
+
+#include <array>
+
+#include <cassert>
+
+namespace
+{
+	constexpr int kHead = 6;
+
+	glm::vec4 const kWhite{ 1.0f, 1.0f, 1.0f, 1.0f };
+	glm::vec4 const kBlack{ 0.0f, 0.0f, 0.0f, 1.0f };
+}
+
+const std::vector<DogPart>& dogParts()
+{
+	static const std::vector<DogPart> parts = {
+		// Torso
+		{ -1, DogJoint::Fixed, { 0.0f, 1.5f, 0.0f }, { 0.6f, 0.6f, 1.2f }, kWhite },
+
+		// Legs
+		{ -1, DogJoint::LegForward, { -0.3f, -2.5f * 0.3f + 1.5f, -0.6f }, { 0.5f * 0.3f, 2.0f * 0.3f, 0.5f * 0.3f }, kWhite },
+		{ -1, DogJoint::LegBackward, { 0.3f, -2.5f * 0.3f + 1.5f, -0.6f }, { 0.5f * 0.3f, 0.6f, 0.5f * 0.3f }, kWhite },
+		{ -1, DogJoint::LegForward, { 0.3f, -2.5f * 0.3f + 1.5f, 2.0f * 0.3f }, { 0.5f * 0.3f, 0.6f, 0.5f * 0.3f }, kWhite },
+		{ -1, DogJoint::LegBackward, { -0.3f, -2.5f * 0.3f + 1.5f, 0.6f }, { 0.5f * 0.3f, 0.6f, 0.5f * 0.3f }, kWhite },
+
+		// Tail
+		{ -1, DogJoint::Tail, { 0.0f, 1.5f, -3.8f * 0.3f }, { 0.5f * 0.3f, 0.5f * 0.3f, 1.8f * 0.3f }, kWhite },
+
+		// Head, and the parts attached to it
+		{ -1, DogJoint::Fixed, { 0.0f, 2.5f * 0.3f + 1.5f, 3.0f * 0.3f }, { 1.5f * 0.3f, 1.55f * 0.3f, 1.6f * 0.3f }, kWhite },
+
+		// Nose
+		{ kHead, DogJoint::Fixed, { 0.0f, (2.2f - 2.5f) * 0.3f, (4.2f - 3.0f) * 0.3f }, { 0.8f * 0.3f, 0.5f * 0.3f, 1.5f * 0.3f }, kWhite },
+
+		// Ears
+		{ kHead, DogJoint::Fixed, { -0.8f * 0.3f, (3.8f - 2.5f) * 0.3f, (2.6f - 3.0f) * 0.3f }, { 0.5f * 0.3f, 0.3f, 0.5f * 0.3f }, kWhite },
+		{ kHead, DogJoint::Fixed, { 0.8f * 0.3f, (3.8f - 2.5f) * 0.3f, (2.6f - 3.0f) * 0.3f }, { 0.5f * 0.3f, 0.3f, 0.5f * 0.3f }, kWhite },
+
+		// Eyes
+		{ kHead, DogJoint::Fixed, { 0.5f * 0.3f, (3.0f - 2.5f) * 0.3f, (4.4f - 3.0f) * 0.3f }, glm::vec3(0.25f * 0.3f), kBlack },
+		{ kHead, DogJoint::Fixed, { -0.5f * 0.3f, (3.0f - 2.5f) * 0.3f, (4.4f - 3.0f) * 0.3f }, glm::vec3(0.25f * 0.3f), kBlack },
+	};
+
+	return parts;
+}
+
+void buildDogInstances(const glm::mat4& root, const DogPose& pose,
+	std::vector<glm::mat4>& transforms, std::vector<glm::vec4>& colors)
+{
+	auto const& parts = dogParts();
+
+	// World space joint of every part, for the children to build on.
+	std::array<glm::mat4, 16> joints;
+	assert(parts.size() <= joints.size());
+
+	for (size_t i = 0; i < parts.size(); ++i)
+	{
+		auto const& part = parts[i];
+
+		auto const& parent = part.parent < 0 ? root : joints[part.parent];
+		auto joint = glm::translate(parent, part.translation);
+
+		switch (part.joint)
+		{
+		case DogJoint::Fixed:
+			break;
+		case DogJoint::LegForward:
+			joint = glm::rotate(joint, glm::radians(pose.legsAngle), { 1.0f, 0.0f, 0.0f });
+			break;
+		case DogJoint::LegBackward:
+			joint = glm::rotate(joint, glm::radians(-pose.legsAngle), { 1.0f, 0.0f, 0.0f });
+			break;
+		case DogJoint::Tail:
+			joint = glm::rotate(joint, glm::radians(-30.0f), { 1.0f, 0.0f, 0.0f });
+			joint = glm::rotate(joint, glm::radians(pose.tailVerticalAngle), { 1.0f, 0.0f, 0.0f });
+			joint = glm::rotate(joint, glm::radians(pose.tailHorizontalAngle), { 0.0f, 1.0f, 0.0f });
+			joint = glm::rotate(joint, glm::radians(pose.tailWiggleAngle), { 0.0f, 1.0f, 0.0f });
+			break;
+		}
+
+		joints[i] = joint;
+
+		transforms.push_back(glm::scale(joint, part.scale));
+		colors.push_back(part.color);
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "glm.hpp"
+
+// The procedural dog, described as a hierarchy of parts. Every part is the
+// unit sphere, scaled into shape.
+//
+// A part's joint (translation + animated rotation) is relative to its
+// parent's joint and is inherited by its children; the part's scale only
+// shapes its own sphere and is not inherited. The root is the dog's
+// placement in the world.
+
+// Animation state driving the joints, in degrees.
+struct DogPose
+{
+	float legsAngle = 0.0f;
+	float tailHorizontalAngle = 0.0f;
+	float tailVerticalAngle = 0.0f;
+	float tailWiggleAngle = 0.0f;
+};
+
+enum class DogJoint
+{
+	Fixed,
+	// Swings around X by +legsAngle / -legsAngle.
+	LegForward,
+	LegBackward,
+	// Tilted down and swung by the tail angles.
+	Tail
+};
+
+struct DogPart
+{
+	// Index of the parent part, or -1 for parts attached to the root.
+	int parent;
+	DogJoint joint;
+	glm::vec3 translation;
+	glm::vec3 scale;
+	glm::vec4 color;
+};
+
+// The parts of the dog. Parents always precede their children.
+const std::vector<DogPart>& dogParts();
+
+// Appends one transform and color per part of a dog placed at root.
+void buildDogInstances(const glm::mat4& root, const DogPose& pose,
+	std::vector<glm::mat4>& transforms, std::vector<glm::vec4>& colors);
@@ -0,0 +1,212 @@
+#include "frame_pacer.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../support/trace.hpp"
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#	include <timeapi.h>
+#	pragma comment(lib, "winmm.lib")
+#endif
+
+const PresentOptions& PresentOptions::defaults()
+{
+	static const PresentOptions options = [] {
+		PresentOptions result;
+
+		if (const char* mode = std::getenv("PRESENT_MODE"))
+		{
+			if (!parseMode(mode, result.mode))
+				std::fprintf(stderr, "FramePacer: unknown PRESENT_MODE '%s', using default\n", mode);
+		}
+
+		if (const char* cap = std::getenv("PRESENT_FPS_CAP"))
+		{
+			result.fpsCap = static_cast<float>(std::atof(cap));
+		}
+
+		if (const char* frames = std::getenv("PRESENT_FRAMES_IN_FLIGHT"))
+		{
+			result.maxFramesInFlight = static_cast<unsigned>(std::strtoul(frames, nullptr, 10));
+		}
+
+		return result;
+	}();
+
+	return options;
+}
+
+bool PresentOptions::parseMode(const char* name, PresentMode& mode)
+{
+	for (auto candidate : { PresentMode::VSync, PresentMode::Adaptive, PresentMode::Uncapped, PresentMode::Capped })
+	{
+		if (std::strcmp(name, presentModeName(candidate)) == 0)
+		{
+			mode = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* presentModeName(PresentMode mode)
+{
+	switch (mode)
+	{
+	case PresentMode::VSync: return "vsync";
+	case PresentMode::Adaptive: return "adaptive";
+	case PresentMode::Uncapped: return "uncapped";
+	case PresentMode::Capped: return "capped";
+	}
+
+	return "unknown";
+}
+
+FramePacer::~FramePacer()
+{
+	for (auto fence : mFences)
+		glDeleteSync(fence);
+
+#	if defined(_WIN32)
+	if (mFineTimer)
+		timeEndPeriod(1);
+#	endif
+}
+
+void FramePacer::configure(const PresentOptions& options)
+{
+	mOptions = options;
+
+	for (auto fence : mFences)
+		glDeleteSync(fence);
+
+	mFences.clear();
+
+	int interval = 1;
+
+	switch (options.mode)
+	{
+	case PresentMode::VSync:
+		interval = 1;
+		break;
+
+	case PresentMode::Adaptive:
+		if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+		{
+			interval = -1;
+		}
+		else
+		{
+			std::fprintf(stderr, "FramePacer: adaptive V-Sync is not supported, using V-Sync\n");
+			mOptions.mode = PresentMode::VSync;
+		}
+		break;
+
+	case PresentMode::Uncapped:
+	case PresentMode::Capped:
+		interval = 0;
+		break;
+	}
+
+	glfwSwapInterval(interval);
+
+	if (mOptions.mode == PresentMode::Capped && mOptions.fpsCap <= 0.0f)
+		mOptions.mode = PresentMode::Uncapped;
+
+	// The default 15.6 ms scheduler tick would leave nearly every frame of
+	// the cap to the spin loop.
+#	if defined(_WIN32)
+	bool const fineTimer = mOptions.mode == PresentMode::Capped;
+	if (fineTimer != mFineTimer)
+	{
+		if (fineTimer)
+			timeBeginPeriod(1);
+		else
+			timeEndPeriod(1);
+
+		mFineTimer = fineTimer;
+	}
+#	endif
+
+	mNextFrame = Clock::now();
+}
+
+void FramePacer::beginFrame()
+{
+	auto const start = Clock::now();
+
+	if (mOptions.maxFramesInFlight > 0)
+	{
+		OGL_TRACE_SCOPE("wait for gpu");
+
+		while (mFences.size() > mOptions.maxFramesInFlight)
+		{
+			glClientWaitSync(mFences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+			glDeleteSync(mFences.front());
+			mFences.pop_front();
+		}
+	}
+
+	auto const fenced = Clock::now();
+	mGpuWait = std::chrono::duration_cast<Secondsf>(fenced - start).count();
+
+	if (mOptions.mode == PresentMode::Capped)
+	{
+		auto const period = std::chrono::duration_cast<Clock::duration>(Secondsf(1.0f / mOptions.fpsCap));
+
+		{
+			OGL_TRACE_SCOPE("fps cap");
+			waitUntil(mNextFrame);
+		}
+
+		// Frames that ran late move the schedule instead of being made up
+		// for with a burst of uncapped ones.
+		mNextFrame = std::max(mNextFrame + period, Clock::now());
+	}
+
+	mCapWait = std::chrono::duration_cast<Secondsf>(Clock::now() - fenced).count();
+}
+
+void FramePacer::endFrame()
+{
+	if (mOptions.maxFramesInFlight == 0)
+		return;
+
+	mFences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+void FramePacer::waitUntil(Clock::time_point deadline)
+{
+	using namespace std::chrono_literals;
+
+	for (;;)
+	{
+		auto const now = Clock::now();
+		if (now >= deadline)
+			return;
+
+		if (deadline - now > mSleepOvershoot)
+		{
+			std::this_thread::sleep_for(1ms);
+
+			// A slowly decaying maximum of how long a 1 ms sleep takes; closer
+			// than that to the deadline, only spinning is precise enough.
+			mSleepOvershoot = std::max<Clock::duration>(Clock::now() - now, mSleepOvershoot - mSleepOvershoot / 64);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
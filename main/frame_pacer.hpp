@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glad.h>
+
+#include <deque>
+
+#include "defaults.hpp"
+
+enum class PresentMode
+{
+	// Swap interval 1: never tears, but a missed refresh halves the rate.
+	VSync,
+	// Swap interval -1 (EXT_swap_control_tear): synchronized while the frame
+	// rate keeps up, tears instead of waiting a whole refresh when late.
+	// Falls back to VSync where unsupported.
+	Adaptive,
+	// Swap interval 0, as fast as the GPU goes.
+	Uncapped,
+	// Swap interval 0, paced to PresentOptions::fpsCap by the CPU.
+	Capped
+};
+
+struct PresentOptions
+{
+	PresentMode mode = PresentMode::VSync;
+
+	// Frame rate of PresentMode::Capped.
+	float fpsCap = 60.0f;
+
+	// Frames the GPU may still be working on when the CPU starts the next
+	// one; 0 leaves queueing to the driver. Lower trades throughput for
+	// input-to-display latency.
+	unsigned maxFramesInFlight = 1;
+
+	// Process-wide defaults. Can be overridden without recompiling via the
+	// PRESENT_MODE ("vsync", "adaptive", "uncapped" or "capped"),
+	// PRESENT_FPS_CAP and PRESENT_FRAMES_IN_FLIGHT environment variables
+	// (and the matching command line options, see main.cpp).
+	static const PresentOptions& defaults();
+
+	// Parses a PRESENT_MODE value. Returns false for unknown names.
+	static bool parseMode(const char* name, PresentMode& mode);
+};
+
+const char* presentModeName(PresentMode mode);
+
+// Frame pacing for the main loop:
+//
+//	pacer.beginFrame();
+//	... poll input, simulate, draw ...
+//	glfwSwapBuffers(window);
+//	pacer.endFrame();
+//
+// endFrame() fences each frame; beginFrame() waits until no more than
+// maxFramesInFlight earlier frames are unfinished on the GPU, and, when
+// capped, until the frame's slot has come. Both happen before input is
+// sampled, so the waiting does not add to the latency.
+class FramePacer
+{
+public:
+	FramePacer() = default;
+	~FramePacer();
+
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+
+	// Sets the swap interval. Requires the window's context to be current.
+	void configure(const PresentOptions& options);
+
+	const PresentOptions& options() const { return mOptions; }
+
+	void beginFrame();
+	void endFrame();
+
+	// Time the last beginFrame() spent waiting for the GPU and for the cap.
+	float gpuWait() const { return mGpuWait; }
+	float capWait() const { return mCapWait; }
+
+private:
+	// Sleeps for as long as the OS reliably wakes up in time and spins for
+	// the rest.
+	void waitUntil(Clock::time_point deadline);
+
+	PresentOptions mOptions;
+
+	std::deque<GLsync> mFences;
+
+	Clock::time_point mNextFrame;
+	Clock::duration mSleepOvershoot = std::chrono::milliseconds(2);
+	bool mFineTimer = false;
+
+	float mGpuWait = 0.0f;
+	float mCapWait = 0.0f;
+};
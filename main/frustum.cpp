@@ -0,0 +1,136 @@
+#include "frustum.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define FRUSTUM_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection)
+{
+	// glm is column major; row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+	auto row = [&viewProjection](int i) {
+		return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	};
+
+	Frustum frustum;
+	frustum.planes[Left] = row(3) + row(0);
+	frustum.planes[Right] = row(3) - row(0);
+	frustum.planes[Bottom] = row(3) + row(1);
+	frustum.planes[Top] = row(3) - row(1);
+	frustum.planes[Near] = row(3) + row(2);
+	frustum.planes[Far] = row(3) - row(2);
+
+	for (auto& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+	for (auto const& plane : planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+
+	return true;
+}
+
+void SphereBatch::clear()
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	radius.clear();
+}
+
+void SphereBatch::add(const glm::vec4& sphere)
+{
+	x.push_back(sphere.x);
+	y.push_back(sphere.y);
+	z.push_back(sphere.z);
+	radius.push_back(sphere.w);
+}
+
+namespace
+{
+	bool sphereVisible(const Frustum& frustum, const ScreenSizeCull& screenSize, float x, float y, float z, float radius)
+	{
+		for (auto const& plane : frustum.planes)
+		{
+			if (plane.x * x + plane.y * y + plane.z * z + plane.w < -radius)
+				return false;
+		}
+
+		// Distance from the near plane stands in for view depth; it errs
+		// towards keeping objects.
+		auto const& near = frustum.planes[Frustum::Near];
+		float const depth = near.x * x + near.y * y + near.z * z + near.w;
+
+		return radius * screenSize.projectionScale >= screenSize.minRadius * depth;
+	}
+}
+
+size_t cullSpheres(const Frustum& frustum, const SphereBatch& spheres, const ScreenSizeCull& screenSize, uint8_t* visible)
+{
+	size_t const count = spheres.size();
+	size_t visibleCount = 0;
+	size_t i = 0;
+
+#	if defined(FRUSTUM_SSE2)
+	__m128 planeX[Frustum::PlaneCount], planeY[Frustum::PlaneCount], planeZ[Frustum::PlaneCount], planeW[Frustum::PlaneCount];
+
+	for (int p = 0; p < Frustum::PlaneCount; ++p)
+	{
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+
+	__m128 const projectionScale = _mm_set1_ps(screenSize.projectionScale);
+	__m128 const minRadius = _mm_set1_ps(screenSize.minRadius);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 const x = _mm_loadu_ps(spheres.x.data() + i);
+		__m128 const y = _mm_loadu_ps(spheres.y.data() + i);
+		__m128 const z = _mm_loadu_ps(spheres.z.data() + i);
+		__m128 const radius = _mm_loadu_ps(spheres.radius.data() + i);
+		__m128 const negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		__m128 nearDistance = _mm_setzero_ps();
+
+		for (int p = 0; p < Frustum::PlaneCount; ++p)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y));
+			distance = _mm_add_ps(distance, _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+
+			if (p == Frustum::Near)
+				nearDistance = distance;
+		}
+
+		__m128 const largeEnough = _mm_cmpge_ps(_mm_mul_ps(radius, projectionScale), _mm_mul_ps(minRadius, nearDistance));
+		int const mask = _mm_movemask_ps(_mm_and_ps(inside, largeEnough));
+
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			uint8_t const laneVisible = (mask >> lane) & 1;
+			visible[i + lane] = laneVisible;
+			visibleCount += laneVisible;
+		}
+	}
+#	endif
+
+	for (; i < count; ++i)
+	{
+		visible[i] = sphereVisible(frustum, screenSize, spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i]) ? 1 : 0;
+		visibleCount += visible[i];
+	}
+
+	return visibleCount;
+}
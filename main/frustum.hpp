@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "glm.hpp"
+
+// View frustum as six inward-facing planes (xyz = normal, w = distance),
+// in the space the matrix it was extracted from maps out of (world space
+// for a view-projection matrix). Planes are normalized, so plane distances
+// are in world units.
+struct Frustum
+{
+	enum Plane
+	{
+		Left,
+		Right,
+		Bottom,
+		Top,
+		Near,
+		Far,
+		PlaneCount
+	};
+
+	glm::vec4 planes[PlaneCount];
+
+	// Gribb/Hartmann extraction from the rows of a GL clip-space matrix.
+	static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+	bool intersectsSphere(const glm::vec3& center, float radius) const;
+};
+
+// Bounding spheres in structure-of-arrays layout, so that cullSpheres() can
+// test four at a time.
+struct SphereBatch
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+
+	void clear();
+	void add(const glm::vec4& sphere);
+
+	size_t size() const { return x.size(); }
+};
+
+// Small-object culling for cullSpheres(): spheres whose projected radius is
+// below minRadius pixels are dropped. projectionScale is
+// projection[1][1] * viewportHeight / 2. A minRadius of 0 disables the test.
+struct ScreenSizeCull
+{
+	float projectionScale = 0.0f;
+	float minRadius = 0.0f;
+};
+
+// Sets visible[i] to 1 if sphere i intersects the frustum and passes the
+// screen size test, 0 otherwise. Returns the number of visible spheres.
+// Uses SSE2 (four spheres per iteration) where available.
+size_t cullSpheres(const Frustum& frustum, const SphereBatch& spheres, const ScreenSizeCull& screenSize, uint8_t* visible);
@@ -0,0 +1,262 @@
+#include "gl_texture.hpp"
+
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+
+// The stb_image implementation is compiled into texture.cpp.
+#include <stb_image.h>
+
+GLenum imagePixelFormat(int channels)
+{
+	switch (channels)
+	{
+	case 1: return GL_RED;
+	case 2: return GL_RG;
+	case 3: return GL_RGB;
+	default: return GL_RGBA;
+	}
+}
+
+GLenum imageInternalFormat(int channels)
+{
+	switch (channels)
+	{
+	case 1: return GL_R8;
+	case 2: return GL_RG8;
+	case 3: return GL_RGB8;
+	default: return GL_RGBA8;
+	}
+}
+
+int mipLevelCount(int width, int height)
+{
+	int levels = 1;
+	for (int size = std::max(width, height); size > 1; size >>= 1)
+		++levels;
+	return levels;
+}
+
+namespace
+{
+	void setSamplerState(GLenum target)
+	{
+		if (GL_TEXTURE_CUBE_MAP == target)
+		{
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		}
+		else
+		{
+			glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
+	}
+
+	void texImage(GLenum target, const ImageData& image)
+	{
+		// Rows of 1-3 channel images are not necessarily 4-byte aligned.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(target, 0, imageInternalFormat(image.channels), image.width, image.height, 0,
+			imagePixelFormat(image.channels), GL_UNSIGNED_BYTE, image.pixels.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	// Bytes of a mip chain of 8-bit texels.
+	size_t chainBytes(int width, int height, int channels, int levels)
+	{
+		size_t bytes = 0;
+
+		for (int level = 0; level < levels; ++level)
+		{
+			bytes += size_t(width) * height * channels;
+
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+
+		return bytes;
+	}
+
+	size_t gTextureBytes = 0;
+}
+
+bool decodeImage(const std::string& path, bool flipVertically, ImageData& image)
+{
+	int width, height, channels;
+	stbi_uc* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+
+	if (!data)
+	{
+		std::cerr << "Texture failed to load at path: " << path << " (" << stbi_failure_reason() << ")\n";
+		return false;
+	}
+
+	auto const rowSize = size_t(width) * channels;
+
+	image.width = width;
+	image.height = height;
+	image.channels = channels;
+	image.pixels.resize(rowSize * height);
+
+	// Flip here rather than via stbi_set_flip_vertically_on_load(), which is
+	// global state shared by all threads.
+	for (int y = 0; y < height; ++y)
+	{
+		auto const srcRow = flipVertically ? height - 1 - y : y;
+		std::memcpy(image.pixels.data() + rowSize * y, data + rowSize * srcRow, rowSize);
+	}
+
+	stbi_image_free(data);
+
+	return true;
+}
+
+GLTexture::~GLTexture()
+{
+	if (0 != mTexture)
+		glDeleteTextures(1, &mTexture);
+
+	gTextureBytes -= mBytes;
+}
+
+GLTexture::GLTexture(GLTexture&& other) noexcept
+	: mTexture(std::exchange(other.mTexture, 0))
+	, mTarget(other.mTarget)
+	, mLevels(other.mLevels)
+	, mBytes(std::exchange(other.mBytes, 0))
+{}
+
+GLTexture& GLTexture::operator=(GLTexture&& other) noexcept
+{
+	std::swap(mTexture, other.mTexture);
+	std::swap(mTarget, other.mTarget);
+	std::swap(mLevels, other.mLevels);
+	std::swap(mBytes, other.mBytes);
+	return *this;
+}
+
+size_t GLTexture::totalBytes()
+{
+	return gTextureBytes;
+}
+
+void GLTexture::setBytes(size_t bytes)
+{
+	gTextureBytes = gTextureBytes - mBytes + bytes;
+	mBytes = bytes;
+}
+
+void GLTexture::load(const std::string& path)
+{
+	ImageData image;
+	if (decodeImage(path, true, image))
+		upload(image);
+}
+
+void GLTexture::loadCubemap(const std::vector<std::string>& faces)
+{
+	std::vector<ImageData> images(faces.size());
+
+	for (size_t i = 0; i < faces.size(); ++i)
+	{
+		if (!decodeImage(faces[i], false, images[i]))
+			return;
+	}
+
+	uploadCubemap(images);
+}
+
+void GLTexture::upload(const ImageData& image)
+{
+	if (image.empty())
+		return;
+
+	reset(GL_TEXTURE_2D);
+
+	texImage(GL_TEXTURE_2D, image);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	mLevels = mipLevelCount(image.width, image.height);
+	setBytes(chainBytes(image.width, image.height, image.channels, mLevels));
+
+	setSamplerState(GL_TEXTURE_2D);
+}
+
+void GLTexture::uploadCubemap(const std::vector<ImageData>& faces)
+{
+	reset(GL_TEXTURE_CUBE_MAP);
+
+	size_t bytes = 0;
+
+	for (size_t i = 0; i < faces.size() && i < 6; ++i)
+	{
+		if (!faces[i].empty())
+		{
+			texImage(GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i), faces[i]);
+			bytes += faces[i].pixels.size();
+		}
+	}
+
+	mLevels = 1;
+	setBytes(bytes);
+
+	setSamplerState(GL_TEXTURE_CUBE_MAP);
+}
+
+void GLTexture::uploadCompressed(const CompressedImage& image)
+{
+	if (image.empty())
+		return;
+
+	reset(GL_TEXTURE_2D);
+
+	mLevels = static_cast<int>(image.levels.size());
+	setBytes(image.data.size());
+
+	for (int i = 0; i < mLevels; ++i)
+	{
+		auto const& level = image.levels[i];
+		glCompressedTexImage2D(GL_TEXTURE_2D, i, image.format, level.width, level.height, 0,
+			GLsizei(level.size), image.data.data() + level.offset);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mLevels - 1);
+
+	setSamplerState(GL_TEXTURE_2D);
+}
+
+void GLTexture::allocate(GLenum target, int width, int height, int channels)
+{
+	reset(target);
+
+	mLevels = GL_TEXTURE_CUBE_MAP == target ? 1 : mipLevelCount(width, height);
+
+	glTexStorage2D(target, mLevels, imageInternalFormat(channels), width, height);
+
+	setBytes(chainBytes(width, height, channels, mLevels) * (GL_TEXTURE_CUBE_MAP == target ? 6 : 1));
+
+	setSamplerState(target);
+}
+
+void GLTexture::use() const
+{
+	glBindTexture(mTarget, mTexture);
+}
+
+void GLTexture::reset(GLenum target)
+{
+	if (0 != mTexture)
+		glDeleteTextures(1, &mTexture);
+
+	mTarget = target;
+
+	glGenTextures(1, &mTexture);
+	glBindTexture(mTarget, mTexture);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glad.h>
+
+#include <string>
+#include <vector>
+
+#include "texture_cache.hpp"
+
+// Decoded image in CPU memory, tightly packed rows, top row first unless
+// flipped on load.
+struct ImageData
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+
+	std::vector<unsigned char> pixels;
+
+	bool empty() const { return pixels.empty(); }
+};
+
+// Decodes an image file with stb_image. Does not touch OpenGL or any global
+// stb state, so it may be called from worker threads. Returns false (and
+// prints the reason) if the file cannot be decoded.
+bool decodeImage(const std::string& path, bool flipVertically, ImageData& image);
+
+// Pixel transfer format and sized internal format for 1-4 channel 8-bit
+// images.
+GLenum imagePixelFormat(int channels);
+GLenum imageInternalFormat(int channels);
+
+// Number of mip levels in a full chain for the given size.
+int mipLevelCount(int width, int height);
+
+// OpenGL texture object with the same interface as ModelTexture, but with
+// decoding and uploading split into separate steps. load() and loadCubemap()
+// do both at once; the upload*() functions take images that were decoded
+// elsewhere (e.g., on a worker thread) and must be called on the context
+// thread.
+class GLTexture
+{
+public:
+	GLTexture() = default;
+	~GLTexture();
+
+	GLTexture(const GLTexture&) = delete;
+	GLTexture& operator=(const GLTexture&) = delete;
+
+	GLTexture(GLTexture&&) noexcept;
+	GLTexture& operator=(GLTexture&&) noexcept;
+
+	void load(const std::string& path);
+	void loadCubemap(const std::vector<std::string>& faces);
+
+	void upload(const ImageData& image);
+	void uploadCubemap(const std::vector<ImageData>& faces);
+
+	// Uploads a block-compressed image and its prebuilt mip chain with
+	// glCompressedTexImage2D.
+	void uploadCompressed(const CompressedImage& image);
+
+	// Allocates immutable storage (with a full mip chain for 2D textures)
+	// but leaves the contents undefined. Used by TextureStreamer, which fills
+	// the storage over several frames.
+	void allocate(GLenum target, int width, int height, int channels);
+
+	int levels() const { return mLevels; }
+
+	// Binds the texture to the active texture unit.
+	void use() const;
+
+	GLuint id() const { return mTexture; }
+	GLenum target() const { return mTarget; }
+
+	// Approximate size of the texture's storage (drivers may pad, e.g., RGB
+	// to RGBA), and the sum over all live textures.
+	size_t bytes() const { return mBytes; }
+	static size_t totalBytes();
+
+private:
+	void reset(GLenum target);
+	void setBytes(size_t bytes);
+
+	GLuint mTexture = 0;
+	GLenum mTarget = GL_TEXTURE_2D;
+	int mLevels = 1;
+	size_t mBytes = 0;
+};
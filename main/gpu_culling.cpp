@@ -0,0 +1,98 @@
+#include "gpu_culling.hpp"
+
+#include "hiz_buffer.hpp"
+#include "mesh_arena.hpp"
+
+namespace
+{
+	constexpr GLuint kCullGroupSize = 64;
+}
+
+void InstanceCuller::create()
+{
+	mProgram = ShaderProgram{ {{GL_COMPUTE_SHADER, "./assets/shaders/cull_instances.comp"}} };
+
+	glUseProgram(mProgram.programId());
+	mProgram.setInt("hiZ", kHiZTextureUnit);
+}
+
+void InstanceCuller::bindOcclusion(const HiZBuffer* hiZ)
+{
+	mProgram.setBool("occlusionCulling", hiZ != nullptr);
+
+	if (!hiZ)
+		return;
+
+	glActiveTexture(GL_TEXTURE0 + kHiZTextureUnit);
+	glBindTexture(GL_TEXTURE_2D, hiZ->texture());
+	glActiveTexture(GL_TEXTURE0);
+
+	mProgram.setVec2("hiZSize", float(hiZ->width()), float(hiZ->height()));
+	mProgram.setInt("hiZLevels", hiZ->levels());
+	mProgram.setMat4("hiZViewProjection", hiZ->viewProjection());
+}
+
+void InstanceCuller::bindBuffers(const ObjModel& model)
+{
+	mProgram.setVec4("boundingSphere", model.storedBoundingSphere());
+	glUniform1ui(mProgram.uniformLocation("totalInstances"), model.instanceCount());
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, kCullInstancesBinding, model.instanceBuffer(), model.instanceBufferOffset(), model.instanceBufferSize());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCullVisibleInstancesBinding, model.visibleInstanceBuffer());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCullCommandBinding, model.instanceCommandBuffer());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCullOccludedBinding, model.occludedInstanceBuffer());
+}
+
+void InstanceCuller::cull(const ObjModel& model, const Frustum& frustum, size_t lod, const HiZBuffer* hiZ)
+{
+	if (!model.instanceCulling())
+		return;
+
+	// The disoccluded pass draws the same LOD from the second half of the
+	// visible instances.
+	DrawElementsIndirectCommand commands[2];
+	commands[0] = commands[1] = model.instanceCommand(lod);
+	commands[1].baseInstance = model.instanceCount();
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, model.instanceCommandBuffer());
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(commands), commands);
+
+	uint32_t const occludedCount = 0;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, model.occludedInstanceBuffer());
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(occludedCount), &occludedCount);
+
+	if (model.instanceCount() == 0)
+		return;
+
+	mProgram.use();
+
+	glUniform1ui(mProgram.uniformLocation("cullPass"), 0);
+	glUniform4fv(mProgram.uniformLocation("frustumPlanes"), Frustum::PlaneCount, &frustum.planes[0][0]);
+
+	bindOcclusion(hiZ);
+	bindBuffers(model);
+
+	glDispatchCompute((model.instanceCount() + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+}
+
+void InstanceCuller::cullDisoccluded(const ObjModel& model, const HiZBuffer& hiZ)
+{
+	if (!model.instanceCulling() || model.instanceCount() == 0)
+		return;
+
+	mProgram.use();
+
+	glUniform1ui(mProgram.uniformLocation("cullPass"), 1);
+
+	bindOcclusion(&hiZ);
+	bindBuffers(model);
+
+	// One thread per instance; the shader stops at the occluded count.
+	glDispatchCompute((model.instanceCount() + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+}
+
+void InstanceCuller::finish()
+{
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
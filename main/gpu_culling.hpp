@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glad.h>
+
+#include "../support/program.hpp"
+
+#include "frustum.hpp"
+#include "ObjModel.hpp"
+
+class HiZBuffer;
+
+// Storage buffer bindings used by cull_instances.comp.
+constexpr GLuint kCullInstancesBinding = 3;
+constexpr GLuint kCullVisibleInstancesBinding = 4;
+constexpr GLuint kCullCommandBinding = 5;
+constexpr GLuint kCullOccludedBinding = 6;
+
+// Texture unit the Hi-Z pyramid (and, while building it, the depth copy) is
+// bound to.
+constexpr GLuint kHiZTextureUnit = 2;
+
+// Frustum culls the placements of instanced ObjModels on the GPU.
+//
+// A compute shader tests each instance's bounding sphere against the
+// frustum, appends the survivors to the model's visible-instance buffer and
+// counts them in the instanceCount of the model's indirect command, so that
+// ObjModel::drawInstanced() draws only what is on screen without any CPU
+// work per instance or readback. Requires instance culling to be enabled on
+// the model (ObjModel::setInstanceCulling()).
+//
+// With a Hi-Z buffer, culling is two-pass. cull() also drops instances that
+// were hidden behind last frame's depth (reprojected with last frame's
+// view-projection), but remembers them. Once this frame's occluders are
+// drawn and the Hi-Z rebuilt from them, cullDisoccluded() re-tests just
+// those, and ObjModel::drawDisoccludedInstances() draws the ones that came
+// into view, so that nothing pops in a frame late.
+class InstanceCuller
+{
+public:
+	void create();
+
+	// Resets the model's commands (for the given LOD) and dispatches the
+	// early culling pass. hiZ may be null to skip the occlusion test.
+	void cull(const ObjModel& model, const Frustum& frustum, size_t lod = 0, const HiZBuffer* hiZ = nullptr);
+
+	// Re-tests the instances that cull() rejected as occluded against an
+	// up to date Hi-Z buffer.
+	void cullDisoccluded(const ObjModel& model, const HiZBuffer& hiZ);
+
+	// Makes the results of all cull() (or cullDisoccluded()) calls visible
+	// to the draws that consume them. Call once after each batch of them.
+	void finish();
+
+private:
+	void bindOcclusion(const HiZBuffer* hiZ);
+	void bindBuffers(const ObjModel& model);
+
+	ShaderProgram mProgram;
+};
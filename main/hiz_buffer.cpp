@@ -0,0 +1,93 @@
+#include "hiz_buffer.hpp"
+
+#include <algorithm>
+
+#include "gl_texture.hpp"
+#include "gpu_culling.hpp"
+
+namespace
+{
+	constexpr GLuint kHiZGroupSize = 8;
+}
+
+HiZBuffer::~HiZBuffer()
+{
+	glDeleteTextures(1, &mDepthTexture);
+	glDeleteTextures(1, &mPyramid);
+}
+
+void HiZBuffer::create()
+{
+	mProgram = ShaderProgram{ {{GL_COMPUTE_SHADER, "./assets/shaders/hiz_downsample.comp"}} };
+
+	glUseProgram(mProgram.programId());
+	mProgram.setInt("depthTexture", kHiZTextureUnit);
+}
+
+void HiZBuffer::resize(int width, int height)
+{
+	glDeleteTextures(1, &mDepthTexture);
+	glDeleteTextures(1, &mPyramid);
+
+	mWidth = width;
+	mHeight = height;
+	mLevels = mipLevelCount(width, height);
+
+	glGenTextures(1, &mDepthTexture);
+	glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+	glGenTextures(1, &mPyramid);
+	glBindTexture(GL_TEXTURE_2D, mPyramid);
+	glTexStorage2D(GL_TEXTURE_2D, mLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void HiZBuffer::build(int width, int height, const glm::mat4& viewProjection)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (width != mWidth || height != mHeight)
+		resize(width, height);
+
+	mViewProjection = viewProjection;
+
+	glActiveTexture(GL_TEXTURE0 + kHiZTextureUnit);
+	glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+	mProgram.use();
+
+	int sourceWidth = width;
+	int sourceHeight = height;
+
+	for (int level = 0; level < mLevels; ++level)
+	{
+		int const levelWidth = std::max(1, width >> level);
+		int const levelHeight = std::max(1, height >> level);
+
+		// Level 0 reads the depth texture, the others the level above.
+		mProgram.setBool("fromDepth", level == 0);
+		mProgram.setVec2("sourceSize", float(sourceWidth), float(sourceHeight));
+		mProgram.setVec2("destinationSize", float(levelWidth), float(levelHeight));
+
+		glBindImageTexture(0, mPyramid, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, mPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute((levelWidth + kHiZGroupSize - 1) / kHiZGroupSize, (levelHeight + kHiZGroupSize - 1) / kHiZGroupSize, 1);
+
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		sourceWidth = levelWidth;
+		sourceHeight = levelHeight;
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	glActiveTexture(GL_TEXTURE0);
+}
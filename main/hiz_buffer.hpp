@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glad.h>
+
+#include "../support/program.hpp"
+
+#include "glm.hpp"
+
+// Hierarchical-Z pyramid for occlusion culling: level 0 is a copy of the
+// depth buffer, and each further level holds the farthest depth of the 2x2
+// (3x3 along odd edges) texels below it. An object whose nearest depth is
+// behind the pyramid's value for the region it covers is hidden.
+//
+// Built with compute shaders (hiz_downsample.comp) from whatever depth is
+// in the read framebuffer; the result stays valid, together with the
+// view-projection it was rendered with, until the next build(), which
+// makes it usable for reprojected tests in the following frame.
+class HiZBuffer
+{
+public:
+	HiZBuffer() = default;
+	~HiZBuffer();
+
+	HiZBuffer(const HiZBuffer&) = delete;
+	HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+	void create();
+
+	// Copies the read framebuffer's depth (width x height) and downsamples
+	// it. Storage is reallocated when the size changes.
+	void build(int width, int height, const glm::mat4& viewProjection);
+
+	bool valid() const { return mLevels > 0; }
+
+	// R32F, sampled with texelFetch().
+	GLuint texture() const { return mPyramid; }
+
+	int width() const { return mWidth; }
+	int height() const { return mHeight; }
+	int levels() const { return mLevels; }
+
+	const glm::mat4& viewProjection() const { return mViewProjection; }
+
+private:
+	void resize(int width, int height);
+
+	ShaderProgram mProgram;
+
+	GLuint mDepthTexture = 0;
+	GLuint mPyramid = 0;
+
+	int mWidth = 0;
+	int mHeight = 0;
+	int mLevels = 0;
+
+	glm::mat4 mViewProjection{ 1.0f };
+};
@@ -0,0 +1,136 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+#include "../support/trace.hpp"
+
+JobSystem::JobSystem(unsigned threadCount)
+{
+	if (0 == threadCount)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	mWorkers.reserve(threadCount);
+	for (unsigned i = 0; i < threadCount; ++i)
+		mWorkers.emplace_back([this] { workerLoop(); });
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+		mQueue.clear();
+	}
+
+	mWorkAvailable.notify_all();
+
+	for (auto& worker : mWorkers)
+		worker.join();
+}
+
+void JobSystem::submit(std::function<void()> work, std::function<void()> completion)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push_back(Job{ std::move(work), std::move(completion), nullptr });
+		++mOutstanding;
+	}
+
+	mWorkAvailable.notify_one();
+}
+
+size_t JobSystem::runCompletions()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	return runFinished(lock);
+}
+
+void JobSystem::waitAll()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	while (mOutstanding > 0 || !mFinished.empty())
+	{
+		mJobFinished.wait(lock, [this] { return !mFinished.empty(); });
+		runFinished(lock);
+	}
+}
+
+size_t JobSystem::runFinished(std::unique_lock<std::mutex>& lock)
+{
+	size_t count = 0;
+
+	while (!mFinished.empty())
+	{
+		std::vector<Job> finished;
+		finished.swap(mFinished);
+
+		// Completions may submit further jobs, so run them unlocked.
+		lock.unlock();
+
+		try
+		{
+			for (auto& job : finished)
+			{
+				++count;
+
+				if (job.error)
+					std::rethrow_exception(job.error);
+
+				if (job.completion)
+				{
+					OGL_TRACE_SCOPE("job completion");
+					job.completion();
+				}
+			}
+		}
+		catch (...)
+		{
+			lock.lock();
+			throw;
+		}
+
+		lock.lock();
+	}
+
+	return count;
+}
+
+void JobSystem::workerLoop()
+{
+	Tracer::instance().setThreadName("job worker");
+
+	for (;;)
+	{
+		Job job;
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkAvailable.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+
+			if (mStopping)
+				return;
+
+			job = std::move(mQueue.front());
+			mQueue.pop_front();
+		}
+
+		try
+		{
+			OGL_TRACE_SCOPE("job");
+			job.work();
+		}
+		catch (...)
+		{
+			job.error = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mFinished.push_back(std::move(job));
+			--mOutstanding;
+		}
+
+		mJobFinished.notify_all();
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+// Small worker pool for asset loading.
+//
+// Each job has two parts: work, which runs on one of the worker threads and
+// must not touch OpenGL, and an optional completion, which runs on the thread
+// that calls runCompletions()/waitAll() (i.e., the thread owning the GL
+// context). This lets file reading, parsing and decoding overlap, while only
+// the GL object creation is serialized on the context thread.
+//
+// Exceptions thrown by work are caught on the worker and rethrown from
+// runCompletions()/waitAll() on the owning thread.
+class JobSystem
+{
+public:
+	// threadCount = 0 uses all hardware threads.
+	explicit JobSystem(unsigned threadCount = 0);
+
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	void submit(std::function<void()> work, std::function<void()> completion = {});
+
+	// Runs the completions of all jobs that have finished so far. Does not
+	// block. Returns the number of completions that were run.
+	size_t runCompletions();
+
+	// Blocks until every submitted job has finished, running completions as
+	// the jobs finish.
+	void waitAll();
+
+	unsigned threadCount() const { return static_cast<unsigned>(mWorkers.size()); }
+
+private:
+	struct Job
+	{
+		std::function<void()> work;
+		std::function<void()> completion;
+		std::exception_ptr error;
+	};
+
+	void workerLoop();
+
+	size_t runFinished(std::unique_lock<std::mutex>& lock);
+
+	std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mJobFinished;
+
+	std::deque<Job> mQueue;
+	std::vector<Job> mFinished;
+
+	size_t mOutstanding = 0;
+	bool mStopping = false;
+
+	std::vector<std::thread> mWorkers;
+};
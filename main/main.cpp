@@ -1,12 +1,56 @@
 #include "renderer.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
+#include "benchmark.hpp"
+#include "vertex_welder.hpp"
+
 OpenGLRenderer renderer;
 
 float frameTime = 0.0f;
 
-int main() try
+int main(int argc, char* argv[]) try
 {
-	renderer.startUp();
+	// Offline tools that do not need a window or GL context
+	if (argc > 1 && 0 == std::strcmp(argv[1], "--bench-weld"))
+	{
+		benchmarkVertexWelding({
+			"./assets/models/House.obj",
+			"./assets/models/tree.obj",
+			"./assets/models/Table.obj",
+			"./assets/models/dragon.obj",
+			"./assets/models/dog/12228_Dog_v1_L2.obj"
+		});
+		return 0;
+	}
+
+	// "--benchmark N" draws N frames offscreen along a fixed camera path and
+	// reports the frame times, instead of running interactively (see
+	// Benchmark for the other --benchmark-* options). Parsed first, since it
+	// moves the log output off stdout when the report goes there.
+	BenchmarkOptions benchmark;
+	bool const benchmarking = BenchmarkOptions::parse(argc, argv, benchmark);
+
+	if (benchmarking)
+		benchmark.reserveStdout();
+
+	// "--trace file.json" (or OGL_TRACE=file.json) records a Chrome trace of
+	// startup and of every frame; it is written at exit and on F2.
+	if (auto const path = std::getenv("OGL_TRACE"))
+	{
+		Tracer::instance().start(path);
+	}
+
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		if (0 == std::strcmp(argv[i], "--trace"))
+			Tracer::instance().start(argv[i + 1]);
+	}
+
+	Tracer::instance().setThreadName("main");
+
+	renderer.startUp(benchmarking ? benchmark.windowOptions() : WindowOptions{});
 
 	// Other initialization & loading
 	OGL_CHECKPOINT_ALWAYS();
@@ -15,15 +59,61 @@ int main() try
 
 	renderer.loadResources();
 
+	// "--props N" scatters N extra trees and N extra crates around the scene,
+	// "--dogs N" N extra dogs, to stress the instanced paths.
+	//
+	// "--present vsync|adaptive|uncapped|capped", "--fps-cap N" and
+	// "--frames-in-flight N" override the PRESENT_* environment variables.
+	auto present = PresentOptions::defaults();
+
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		auto const count = static_cast<size_t>(std::strtoul(argv[i + 1], nullptr, 10));
+
+		if (0 == std::strcmp(argv[i], "--props"))
+		{
+			renderer.scatterProps(count, count, 150.0f);
+		}
+		else if (0 == std::strcmp(argv[i], "--dogs"))
+		{
+			renderer.scatterDogs(count, 100.0f);
+		}
+		else if (0 == std::strcmp(argv[i], "--present"))
+		{
+			if (!PresentOptions::parseMode(argv[i + 1], present.mode))
+				std::fprintf(stderr, "Unknown presentation mode '%s'\n", argv[i + 1]);
+		}
+		else if (0 == std::strcmp(argv[i], "--fps-cap"))
+		{
+			present.fpsCap = static_cast<float>(std::atof(argv[i + 1]));
+		}
+		else if (0 == std::strcmp(argv[i], "--frames-in-flight"))
+		{
+			present.maxFramesInFlight = static_cast<unsigned>(count);
+		}
+	}
+
+	renderer.framePacer.configure(present);
+
 	OGL_CHECKPOINT_ALWAYS();
 
+	if (benchmarking)
+	{
+		return Benchmark(benchmark).run(renderer);
+	}
+
 	Timer timer;
 
 	// Main loop
 	while(!glfwWindowShouldClose(renderer.getWindow()))
 	{
+		OGL_TRACE_SCOPE("frame");
+
 		timer.Reset();
 
+		// Waits for the GPU and the frame rate cap, before input is sampled.
+		renderer.framePacer.beginFrame();
+
 		// Let GLFW process events
 		glfwPollEvents();
 		
@@ -51,13 +141,13 @@ int main() try
 		}
 
 		// Update state
-		renderer.updateTreeRotation();
-
-		renderer.updateConstantMovement();
+		renderer.updateTextureStreaming();
 
 		//TODO: update state
 		renderer.updateInput(frameTime);
 
+		renderer.updateSimulation(frameTime);
+
 		renderer.updateUniforms();
 
 		// Draw scene
@@ -66,15 +156,28 @@ int main() try
 		//TODO: draw frame
 		renderer.drawScene();
 
+		// Overlay, drawn while toggled on (F1).
+		renderer.perfHud.draw(renderer, frameTime);
+
 		OGL_CHECKPOINT_DEBUG();
 
 		// Display results
-		glfwSwapBuffers(renderer.getWindow());
+		{
+			OGL_TRACE_SCOPE("glfwSwapBuffers");
+			glfwSwapBuffers(renderer.getWindow());
+		}
+
+		renderer.framePacer.endFrame();
+
+		// Per-pass timings, see GpuProfiler::results().
+		GpuProfiler::instance().endFrame();
 
 		frameTime = timer.Elapsed();
 	}
 
 	// Cleanup.
+	renderer.perfHud.destroy();
+
 	//TODO: additional cleanup
 	
 	return 0;
@@ -0,0 +1,180 @@
+#include "mesh_arena.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include <cstdio>
+
+#include "texture_streamer.hpp"
+
+namespace
+{
+	// Immutable when possible; filled with glBufferSubData either way.
+	void allocateStaticBuffer(GLenum target, size_t size)
+	{
+#		if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+		if (bufferStorageSupported())
+		{
+			glBufferStorage(target, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		}
+		else
+#		endif
+		{
+			glBufferData(target, size, nullptr, GL_STATIC_DRAW);
+		}
+	}
+}
+
+MeshArena::~MeshArena()
+{
+	glDeleteVertexArrays(1, &mVao);
+	glDeleteBuffers(1, &mVertexBuffer);
+	glDeleteBuffers(1, &mIndexBuffer);
+}
+
+void MeshArena::create(size_t vertexCapacity, size_t indexCapacity)
+{
+	mVertexCapacity = vertexCapacity;
+	mIndexCapacity = indexCapacity;
+	mVertexCount = 0;
+	mIndexCount = 0;
+
+	glGenVertexArrays(1, &mVao);
+	glBindVertexArray(mVao);
+
+	glGenBuffers(1, &mVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	allocateStaticBuffer(GL_ARRAY_BUFFER, std::max<size_t>(vertexCapacity, 1) * sizeof(PackedMeshVertex));
+
+	glGenBuffers(1, &mIndexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+	allocateStaticBuffer(GL_ELEMENT_ARRAY_BUFFER, std::max<size_t>(indexCapacity, 1) * sizeof(uint32_t));
+
+	setVertexAttributes(VertexFormat::Packed);
+
+	glBindVertexArray(0);
+}
+
+bool MeshArena::allocate(const std::vector<PackedMeshVertex>& vertices, const std::vector<uint32_t>& indices, MeshAllocation& allocation)
+{
+	if (mVertexCount + vertices.size() > mVertexCapacity || mIndexCount + indices.size() > mIndexCapacity)
+	{
+		std::fprintf(stderr, "Mesh arena is full (%zu vertices, %zu indices requested)\n", vertices.size(), indices.size());
+		return false;
+	}
+
+	allocation.baseVertex = static_cast<uint32_t>(mVertexCount);
+	allocation.firstIndex = static_cast<uint32_t>(mIndexCount);
+
+	// Not through the VAO: binding GL_ELEMENT_ARRAY_BUFFER would change
+	// whichever VAO is bound.
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mVertexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, mVertexCount * sizeof(PackedMeshVertex), vertices.size() * sizeof(PackedMeshVertex), vertices.data());
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mIndexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, mIndexCount * sizeof(uint32_t), indices.size() * sizeof(uint32_t), indices.data());
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	mVertexCount += vertices.size();
+	mIndexCount += indices.size();
+
+	return true;
+}
+
+DrawElementsIndirectCommand MeshArena::command(const ObjMesh& mesh, size_t lod, uint32_t baseInstance)
+{
+	DrawElementsIndirectCommand command;
+	command.count = mesh.indexCount;
+	command.instanceCount = 1;
+	command.firstIndex = mesh.firstIndex;
+	command.baseVertex = static_cast<int32_t>(mesh.baseVertex);
+	command.baseInstance = baseInstance;
+
+	if (lod != 0 && lod < mesh.lods.size())
+	{
+		command.count = mesh.lods[lod].indexCount;
+		command.firstIndex += mesh.lods[lod].indexOffset;
+	}
+
+	return command;
+}
+
+IndirectDrawList::~IndirectDrawList()
+{
+	glDeleteBuffers(1, &mDrawIdBuffer);
+}
+
+void IndirectDrawList::create(const MeshArena& arena, StreamBuffer& stream, size_t capacity)
+{
+	mVao = arena.vao();
+	mStream = &stream;
+
+	glGenBuffers(1, &mDrawIdBuffer);
+
+	reserve(capacity);
+}
+
+void IndirectDrawList::reserve(size_t capacity)
+{
+	mCapacity = capacity;
+
+	// Draw i reads element i (its baseInstance) of this attribute.
+	std::vector<uint32_t> drawIds(capacity);
+	std::iota(drawIds.begin(), drawIds.end(), 0u);
+
+	glBindVertexArray(mVao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mDrawIdBuffer);
+	glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(uint32_t), drawIds.data(), GL_STATIC_DRAW);
+
+	glVertexAttribIPointer(kDrawIdAttribute, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+	glEnableVertexAttribArray(kDrawIdAttribute);
+	glVertexAttribDivisor(kDrawIdAttribute, 1);
+
+	glBindVertexArray(0);
+}
+
+void IndirectDrawList::clear()
+{
+	mCommands.clear();
+	mData.clear();
+}
+
+uint32_t IndirectDrawList::add(const ObjMesh& mesh, size_t lod, const IndirectDrawData& data)
+{
+	auto const index = static_cast<uint32_t>(mCommands.size());
+
+	mCommands.push_back(MeshArena::command(mesh, lod, index));
+	mData.push_back(data);
+
+	return index;
+}
+
+void IndirectDrawList::upload()
+{
+	if (mCommands.empty())
+		return;
+
+	if (mCommands.size() > mCapacity)
+		reserve(std::max(mCommands.size(), mCapacity * 2));
+
+	mCommandRange = mStream->write(mCommands.data(), mCommands.size() * sizeof(DrawElementsIndirectCommand), sizeof(uint32_t));
+
+	auto const dataSize = mData.size() * sizeof(IndirectDrawData);
+	auto const data = mStream->write(mData.data(), dataSize, StreamBuffer::storageAlignment());
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, kDrawDataBinding, data.buffer, data.offset, GLsizeiptr(dataSize));
+}
+
+void IndirectDrawList::draw(uint32_t first, uint32_t count) const
+{
+	if (count == 0)
+		return;
+
+	glBindVertexArray(mVao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandRange.buffer);
+
+	auto const offset = mCommandRange.offset + first * sizeof(DrawElementsIndirectCommand);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, static_cast<GLsizei>(count), 0);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "glm.hpp"
+
+#include "ObjModel.hpp"
+#include "stream_buffer.hpp"
+
+// Binding of the IndirectDrawData storage buffer. Shaders declare it as
+//
+//	struct DrawData
+//	{
+//		mat4 model;
+//		mat4 normalMatrix;
+//		vec4 color;
+//	};
+//
+//	layout(std430, binding = 2) readonly buffer DrawDataBuffer
+//	{
+//		DrawData draws[];
+//	};
+constexpr GLuint kDrawDataBinding = 2;
+
+// Attribute location of the draw index (a uint with divisor 1).
+constexpr GLuint kDrawIdAttribute = 8;
+
+// Layout that glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER.
+struct DrawElementsIndirectCommand
+{
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+};
+
+// Per-draw data of an indirect draw, std430 mirror of DrawData above.
+struct IndirectDrawData
+{
+	glm::mat4 model;
+	glm::mat4 normalMatrix;
+	glm::vec4 color;
+};
+
+static_assert(sizeof(IndirectDrawData) == 2 * 64 + 16, "IndirectDrawData must match the std430 layout");
+
+struct MeshAllocation
+{
+	uint32_t baseVertex = 0;
+	uint32_t firstIndex = 0;
+};
+
+// Static meshes suballocated from one vertex buffer (PackedMeshVertex) and
+// one index buffer (32-bit, relative to each mesh's base vertex), both
+// immutable when GL 4.4 / ARB_buffer_storage is available. The arena's VAO
+// covers all of them, so any number of meshes can be drawn without a VAO
+// switch, e.g. by one glMultiDrawElementsIndirect.
+//
+// Allocation is linear; the arena is sized once (after loading) and never
+// frees individual meshes.
+class MeshArena
+{
+public:
+	MeshArena() = default;
+	~MeshArena();
+
+	MeshArena(const MeshArena&) = delete;
+	MeshArena& operator=(const MeshArena&) = delete;
+
+	void create(size_t vertexCapacity, size_t indexCapacity);
+
+	// Copies the vertices and indices into the arena. Returns false if they
+	// do not fit.
+	bool allocate(const std::vector<PackedMeshVertex>& vertices, const std::vector<uint32_t>& indices, MeshAllocation& allocation);
+
+	// Command for drawing one LOD of a mesh that was created in this arena
+	// (see ObjModel::createBuffers(MeshArena&)).
+	static DrawElementsIndirectCommand command(const ObjMesh& mesh, size_t lod, uint32_t baseInstance);
+
+	GLuint vao() const { return mVao; }
+	GLuint vertexBuffer() const { return mVertexBuffer; }
+	GLuint indexBuffer() const { return mIndexBuffer; }
+
+	size_t vertexCount() const { return mVertexCount; }
+	size_t indexCount() const { return mIndexCount; }
+
+	// Size of both buffers.
+	size_t bytes() const { return mVertexCapacity * sizeof(PackedMeshVertex) + mIndexCapacity * sizeof(uint32_t); }
+
+private:
+	GLuint mVao = 0;
+	GLuint mVertexBuffer = 0;
+	GLuint mIndexBuffer = 0;
+
+	size_t mVertexCapacity = 0;
+	size_t mIndexCapacity = 0;
+	size_t mVertexCount = 0;
+	size_t mIndexCount = 0;
+};
+
+// One frame's worth of indirect draws from a MeshArena. Draw i's
+// baseInstance is i, which reaches the vertex shader through an instanced
+// kDrawIdAttribute (gl_DrawID would need GL 4.6) and selects its
+// IndirectDrawData.
+//
+// Typical use: clear(), add() every draw, upload() once, then draw() ranges
+// of consecutive draws that share a program and textures.
+class IndirectDrawList
+{
+public:
+	IndirectDrawList() = default;
+	~IndirectDrawList();
+
+	IndirectDrawList(const IndirectDrawList&) = delete;
+	IndirectDrawList& operator=(const IndirectDrawList&) = delete;
+
+	// Adds the draw index attribute to the arena's VAO. The commands and draw
+	// data are written to the stream, which must outlive the list.
+	void create(const MeshArena& arena, StreamBuffer& stream, size_t capacity = 256);
+
+	void clear();
+
+	// Returns the index of the new draw.
+	uint32_t add(const ObjMesh& mesh, size_t lod, const IndirectDrawData& data);
+
+	// Writes the commands and draw data to this frame's part of the stream
+	// and binds the data. Grows the draw index attribute if needed.
+	void upload();
+
+	// Draws commands [first, first + count) with one glMultiDrawElementsIndirect.
+	void draw(uint32_t first, uint32_t count) const;
+
+	uint32_t size() const { return static_cast<uint32_t>(mCommands.size()); }
+
+private:
+	void reserve(size_t capacity);
+
+	GLuint mVao = 0;
+	GLuint mDrawIdBuffer = 0;
+
+	StreamBuffer* mStream = nullptr;
+	StreamBuffer::Range mCommandRange;
+
+	size_t mCapacity = 0;
+
+	std::vector<DrawElementsIndirectCommand> mCommands;
+	std::vector<IndirectDrawData> mData;
+};
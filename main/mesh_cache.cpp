@@ -0,0 +1,350 @@
+#include "mesh_cache.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <filesystem>
+#include <system_error>
+
+namespace
+{
+	// Bump whenever the layout of the header or of MeshVertex changes.
+	constexpr uint32_t kMeshCacheVersion = 4;
+
+	constexpr char kMeshCacheMagic[8] = { 'O', 'B', 'J', 'M', 'E', 'S', 'H', '\0' };
+
+	struct MeshCacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t vertexStride;
+		uint32_t flags;
+		uint32_t lodCount;
+
+		uint64_t sourceSize;
+		int64_t sourceMtime;
+		uint64_t sourceHash;
+
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		uint64_t lodIndexCount;
+
+		float boundsMin[3];
+		float boundsMax[3];
+		float boundingSphere[4];
+	};
+
+	struct SourceStamp
+	{
+		uint64_t size = 0;
+		int64_t mtime = 0;
+	};
+
+	struct FileCloser
+	{
+		void operator()(std::FILE* file) const { std::fclose(file); }
+	};
+
+	using FilePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+	bool statSource(const std::string& path, SourceStamp& stamp)
+	{
+		std::error_code ec;
+
+		auto size = std::filesystem::file_size(path, ec);
+		if (ec)
+			return false;
+
+		auto mtime = std::filesystem::last_write_time(path, ec);
+		if (ec)
+			return false;
+
+		stamp.size = size;
+		stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+
+		return true;
+	}
+
+	// 64-bit content hash, processing the input eight bytes at a time. This
+	// only needs to detect edits to the source file, so a fast non-cryptographic
+	// mix (in the spirit of xxHash/wyhash) is sufficient.
+	uint64_t mix64(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	uint64_t hashBlock(uint64_t h, const unsigned char* data, size_t size)
+	{
+		constexpr uint64_t kPrime = 0x9e3779b97f4a7c15ull;
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, data + i, sizeof(word));
+			h = (h ^ mix64(word)) * kPrime;
+		}
+
+		uint64_t tail = 0;
+		std::memcpy(&tail, data + i, size - i);
+		h = (h ^ mix64(tail ^ (size - i))) * kPrime;
+
+		return h;
+	}
+
+	bool hashSource(const std::string& path, uint64_t& hash)
+	{
+		FilePtr file(std::fopen(path.c_str(), "rb"));
+		if (!file)
+			return false;
+
+		// Blocks are a multiple of eight bytes, so only the very last one has
+		// a partial tail.
+		std::vector<unsigned char> block(1 << 20);
+
+		uint64_t h = 0xcbf29ce484222325ull;
+		uint64_t total = 0;
+
+		while (size_t read = std::fread(block.data(), 1, block.size(), file.get()))
+		{
+			h = hashBlock(h, block.data(), read);
+			total += read;
+		}
+
+		if (std::ferror(file.get()))
+			return false;
+
+		hash = mix64(h ^ total);
+
+		return true;
+	}
+
+	// Whether the counts in the header add up to the size of the file, so
+	// that a corrupt header never turns into a huge allocation.
+	bool countsMatchSize(const MeshCacheHeader& header, uint64_t fileSize)
+	{
+		if (fileSize < sizeof(header))
+			return false;
+
+		uint64_t remaining = fileSize - sizeof(header);
+
+		auto take = [&remaining](uint64_t count, uint64_t size)
+		{
+			if (count > remaining / size)
+				return false;
+
+			remaining -= count * size;
+			return true;
+		};
+
+		return take(header.vertexCount, sizeof(MeshVertex)) &&
+			take(header.indexCount, sizeof(uint32_t)) &&
+			take(header.lodIndexCount, sizeof(uint32_t)) &&
+			take(header.lodCount, sizeof(MeshLod)) &&
+			remaining == 0;
+	}
+
+	// Indices past the vertices, or LODs past the indices, would be read out
+	// of bounds when drawing.
+	bool rangesValid(size_t vertexCount, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& lodIndices,
+		const std::vector<MeshLod>& lods)
+	{
+		for (auto index : indices)
+		{
+			if (index >= vertexCount)
+				return false;
+		}
+
+		for (auto index : lodIndices)
+		{
+			if (index >= vertexCount)
+				return false;
+		}
+
+		uint64_t const totalIndices = uint64_t(indices.size()) + lodIndices.size();
+
+		for (auto const& lod : lods)
+		{
+			if (uint64_t(lod.indexOffset) + lod.indexCount > totalIndices)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool writeHeader(const std::string& cachePath, const MeshCacheHeader& header)
+	{
+		FilePtr file(std::fopen(cachePath.c_str(), "r+b"));
+		if (!file)
+			return false;
+
+		return std::fwrite(&header, sizeof(header), 1, file.get()) == 1;
+	}
+}
+
+std::string meshCachePath(const std::string& sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+bool loadMeshCache(const std::string& sourcePath, ObjMesh& mesh, uint32_t flags)
+{
+	SourceStamp stamp;
+	if (!statSource(sourcePath, stamp))
+		return false;
+
+	auto cachePath = meshCachePath(sourcePath);
+
+	MeshCacheHeader header;
+
+	{
+		FilePtr file(std::fopen(cachePath.c_str(), "rb"));
+		if (!file)
+			return false;
+
+		if (std::fread(&header, sizeof(header), 1, file.get()) != 1)
+			return false;
+
+		if (std::memcmp(header.magic, kMeshCacheMagic, sizeof(kMeshCacheMagic)) != 0 ||
+			header.version != kMeshCacheVersion ||
+			header.vertexStride != sizeof(MeshVertex) ||
+			header.flags != flags ||
+			header.sourceSize != stamp.size)
+		{
+			return false;
+		}
+
+		if (header.sourceMtime != stamp.mtime)
+		{
+			// The file was touched (e.g., by a checkout); only rebuild the
+			// cache if its contents actually changed.
+			uint64_t hash;
+			if (!hashSource(sourcePath, hash) || hash != header.sourceHash)
+				return false;
+		}
+
+		std::error_code ec;
+		auto const fileSize = std::filesystem::file_size(cachePath, ec);
+
+		if (ec || !countsMatchSize(header, fileSize))
+		{
+			std::cerr << "MeshCache: corrupt cache '" << cachePath << "'\n";
+			return false;
+		}
+
+		std::vector<MeshVertex> vertices(header.vertexCount);
+		std::vector<uint32_t> indices(header.indexCount);
+		std::vector<uint32_t> lodIndices(header.lodIndexCount);
+		std::vector<MeshLod> lods(header.lodCount);
+
+		if (std::fread(vertices.data(), sizeof(MeshVertex), vertices.size(), file.get()) != vertices.size() ||
+			std::fread(indices.data(), sizeof(uint32_t), indices.size(), file.get()) != indices.size() ||
+			std::fread(lodIndices.data(), sizeof(uint32_t), lodIndices.size(), file.get()) != lodIndices.size() ||
+			std::fread(lods.data(), sizeof(MeshLod), lods.size(), file.get()) != lods.size())
+		{
+			std::cerr << "MeshCache: truncated cache '" << cachePath << "'\n";
+			return false;
+		}
+
+		if (!rangesValid(vertices.size(), indices, lodIndices, lods))
+		{
+			std::cerr << "MeshCache: corrupt cache '" << cachePath << "'\n";
+			return false;
+		}
+
+		mesh.vertices = std::move(vertices);
+		mesh.indices = std::move(indices);
+		mesh.lodIndices = std::move(lodIndices);
+		mesh.lods = std::move(lods);
+		mesh.boundsMin = { header.boundsMin[0], header.boundsMin[1], header.boundsMin[2] };
+		mesh.boundsMax = { header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] };
+		mesh.boundingSphere = { header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2], header.boundingSphere[3] };
+	}
+
+	if (header.sourceMtime != stamp.mtime)
+	{
+		header.sourceMtime = stamp.mtime;
+
+		if (!writeHeader(cachePath, header))
+			std::cerr << "MeshCache: unable to refresh '" << cachePath << "'\n";
+	}
+
+	return true;
+}
+
+bool storeMeshCache(const std::string& sourcePath, const ObjMesh& mesh, uint32_t flags)
+{
+	MeshCacheHeader header = {};
+	std::memcpy(header.magic, kMeshCacheMagic, sizeof(kMeshCacheMagic));
+	header.version = kMeshCacheVersion;
+	header.vertexStride = sizeof(MeshVertex);
+	header.flags = flags;
+
+	SourceStamp stamp;
+	if (!statSource(sourcePath, stamp) || !hashSource(sourcePath, header.sourceHash))
+		return false;
+
+	header.sourceSize = stamp.size;
+	header.sourceMtime = stamp.mtime;
+
+	header.vertexCount = mesh.vertices.size();
+	header.indexCount = mesh.indices.size();
+	header.lodIndexCount = mesh.lodIndices.size();
+	header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+
+	for (int i = 0; i < 3; ++i)
+	{
+		header.boundsMin[i] = mesh.boundsMin[i];
+		header.boundsMax[i] = mesh.boundsMax[i];
+	}
+
+	for (int i = 0; i < 4; ++i)
+		header.boundingSphere[i] = mesh.boundingSphere[i];
+
+	// Write to a temporary file first and move it into place, so that an
+	// interrupted write never leaves a valid-looking but truncated cache.
+	auto cachePath = meshCachePath(sourcePath);
+	auto tempPath = cachePath + ".tmp";
+
+	{
+		FilePtr file(std::fopen(tempPath.c_str(), "wb"));
+		if (!file)
+		{
+			std::cerr << "MeshCache: unable to create '" << tempPath << "'\n";
+			return false;
+		}
+
+		if (std::fwrite(&header, sizeof(header), 1, file.get()) != 1 ||
+			std::fwrite(mesh.vertices.data(), sizeof(MeshVertex), mesh.vertices.size(), file.get()) != mesh.vertices.size() ||
+			std::fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file.get()) != mesh.indices.size() ||
+			std::fwrite(mesh.lodIndices.data(), sizeof(uint32_t), mesh.lodIndices.size(), file.get()) != mesh.lodIndices.size() ||
+			std::fwrite(mesh.lods.data(), sizeof(MeshLod), mesh.lods.size(), file.get()) != mesh.lods.size())
+		{
+			std::cerr << "MeshCache: error while writing '" << tempPath << "'\n";
+			file.reset();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, cachePath, ec);
+
+	if (ec)
+	{
+		std::cerr << "MeshCache: unable to replace '" << cachePath << "': " << ec.message() << "\n";
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
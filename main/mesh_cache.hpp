@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+#include <cstdint>
+
+#include "ObjModel.hpp"
+
+// Binary cache of a fully processed ObjMesh (deduplicated vertices, indices,
+// LODs and bounds). The cache lives next to the source as "<source>.meshcache" and
+// is keyed by the source's size, modification time and content hash:
+//
+//	- size and mtime match: the cache is used as is, without touching the OBJ;
+//	- size matches but mtime differs: the OBJ is hashed, and if the content is
+//	  unchanged the cache is used and its recorded mtime refreshed;
+//	- anything else: the cache is stale and the OBJ is parsed again.
+//
+// Failing to read or write a cache is never fatal; the loader simply falls
+// back to parsing the OBJ.
+//
+// The flags record which optional processing steps were applied to the
+// stored mesh; a cache written with different flags is treated as stale.
+enum MeshCacheFlags : uint32_t
+{
+	kMeshCacheOptimized = 1u << 0,
+	kMeshCacheLods = 1u << 1,
+};
+
+std::string meshCachePath(const std::string& sourcePath);
+
+bool loadMeshCache(const std::string& sourcePath, ObjMesh& mesh, uint32_t flags);
+
+bool storeMeshCache(const std::string& sourcePath, const ObjMesh& mesh, uint32_t flags);
@@ -0,0 +1,345 @@
+#include "mesh_optimizer.hpp"
+
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+namespace
+{
+	// Parameters from Tom Forsyth, "Linear-Speed Vertex Cache Optimisation".
+	constexpr int kForsythCacheSize = 32;
+	constexpr float kCacheDecayPower = 1.5f;
+	constexpr float kLastTriScore = 0.75f;
+	constexpr float kValenceBoostScale = 2.0f;
+	constexpr float kValenceBoostPower = 0.5f;
+
+	float forsythScore(int cachePosition, uint32_t liveTriangles)
+	{
+		if (liveTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// The last triangle's vertices get a fixed score, so that
+				// strips are not favoured over fans.
+				score = kLastTriScore;
+			}
+			else
+			{
+				float const scaler = 1.0f / (kForsythCacheSize - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+			}
+		}
+
+		score += kValenceBoostScale * std::pow(float(liveTriangles), -kValenceBoostPower);
+
+		return score;
+	}
+
+	// Area-weighted centroid and (unnormalized) normal of a run of triangles.
+	void clusterGeometry(const uint32_t* indices, size_t triangleCount, const std::vector<MeshVertex>& vertices, glm::vec3& centroid, glm::vec3& normal, float& area)
+	{
+		centroid = glm::vec3(0.0f);
+		normal = glm::vec3(0.0f);
+		area = 0.0f;
+
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			auto const& p0 = vertices[indices[3 * t + 0]].position;
+			auto const& p1 = vertices[indices[3 * t + 1]].position;
+			auto const& p2 = vertices[indices[3 * t + 2]].position;
+
+			auto const n = glm::cross(p1 - p0, p2 - p0);
+			float const a = glm::length(n);
+
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		if (area > 0.0f)
+			centroid /= area;
+	}
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize)
+{
+	VertexCacheStats stats;
+
+	if (indices.empty() || vertexCount == 0)
+		return stats;
+
+	// FIFO cache: a vertex is a hit if it was inserted within the last
+	// cacheSize misses.
+	std::vector<uint32_t> insertedAt(vertexCount, 0);
+	std::vector<bool> used(vertexCount, false);
+
+	uint32_t misses = 0;
+	size_t unique = 0;
+
+	for (auto const index : indices)
+	{
+		if (!used[index])
+		{
+			used[index] = true;
+			++unique;
+		}
+		else if (misses - insertedAt[index] < cacheSize)
+		{
+			continue;
+		}
+
+		insertedAt[index] = misses;
+		++misses;
+	}
+
+	stats.acmr = float(misses) / float(indices.size() / 3);
+	stats.atvr = float(misses) / float(unique);
+
+	return stats;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	size_t const triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Per-vertex lists of triangles that are not emitted yet. The first
+	// liveTriangles[v] entries of each list are the live ones.
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (auto const index : indices)
+		++liveTriangles[index];
+
+	std::vector<uint32_t> listOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+		listOffset[v + 1] = listOffset[v] + liveTriangles[v];
+
+	std::vector<uint32_t> triangleLists(indices.size());
+	{
+		std::vector<uint32_t> cursor(listOffset.begin(), listOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; ++t)
+			for (int k = 0; k < 3; ++k)
+				triangleLists[cursor[indices[3 * t + k]]++] = uint32_t(t);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = forsythScore(-1, liveTriangles[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; ++t)
+		triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	std::vector<uint32_t> cache, newCache;
+	cache.reserve(kForsythCacheSize + 3);
+	newCache.reserve(kForsythCacheSize + 3);
+
+	size_t scanCursor = 0;
+	auto bestTriangle = static_cast<int64_t>(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+
+	while (output.size() < indices.size())
+	{
+		if (bestTriangle < 0)
+		{
+			// Nothing in the cache has live triangles left; continue with
+			// the next triangle in the original order.
+			while (emitted[scanCursor])
+				++scanCursor;
+			bestTriangle = static_cast<int64_t>(scanCursor);
+		}
+
+		auto const t = static_cast<size_t>(bestTriangle);
+		emitted[t] = true;
+
+		newCache.clear();
+
+		for (int k = 0; k < 3; ++k)
+		{
+			auto const v = indices[3 * t + k];
+			output.push_back(v);
+			newCache.push_back(v);
+
+			// Remove t from v's live list.
+			auto* list = triangleLists.data() + listOffset[v];
+			auto const live = liveTriangles[v];
+			auto const it = std::find(list, list + live, uint32_t(t));
+			std::swap(*it, list[live - 1]);
+			--liveTriangles[v];
+		}
+
+		for (auto const v : cache)
+		{
+			if (std::find(newCache.begin(), newCache.begin() + 3, v) == newCache.begin() + 3)
+				newCache.push_back(v);
+		}
+
+		// Vertices pushed out of the cache lose their cache bonus.
+		for (size_t i = kForsythCacheSize; i < newCache.size(); ++i)
+			cachePosition[newCache[i]] = -1;
+		if (newCache.size() > size_t(kForsythCacheSize))
+			newCache.resize(kForsythCacheSize);
+
+		for (size_t i = 0; i < newCache.size(); ++i)
+			cachePosition[newCache[i]] = int(i);
+
+		// Rescore everything that may have changed, and pick the best live
+		// triangle touching the cache for the next step.
+		for (size_t i = 0; i < cache.size(); ++i)
+		{
+			auto const v = cache[i];
+			if (cachePosition[v] < 0)
+				vertexScore[v] = forsythScore(-1, liveTriangles[v]);
+		}
+
+		for (auto const v : newCache)
+			vertexScore[v] = forsythScore(cachePosition[v], liveTriangles[v]);
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+
+		for (auto const v : newCache)
+		{
+			auto const* list = triangleLists.data() + listOffset[v];
+			for (uint32_t i = 0; i < liveTriangles[v]; ++i)
+			{
+				auto const u = list[i];
+				float const score = vertexScore[indices[3 * u]] + vertexScore[indices[3 * u + 1]] + vertexScore[indices[3 * u + 2]];
+				triangleScore[u] = score;
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = u;
+				}
+			}
+		}
+
+		cache.swap(newCache);
+	}
+
+	indices.swap(output);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices, float threshold)
+{
+	size_t const triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	constexpr unsigned kCacheSize = 16;
+
+	// Split into clusters at hard cache boundaries, i.e. triangles that miss
+	// on all three vertices. Reordering whole clusters leaves the cache
+	// behaviour within each cluster intact.
+	std::vector<size_t> clusterStart;
+	{
+		std::vector<uint32_t> insertedAt(vertices.size(), 0);
+		std::vector<bool> used(vertices.size(), false);
+		uint32_t misses = 0;
+
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			int triangleMisses = 0;
+
+			for (int k = 0; k < 3; ++k)
+			{
+				auto const v = indices[3 * t + k];
+				if (used[v] && misses - insertedAt[v] < kCacheSize)
+					continue;
+
+				used[v] = true;
+				insertedAt[v] = misses++;
+				++triangleMisses;
+			}
+
+			if (triangleMisses == 3)
+				clusterStart.push_back(t);
+		}
+	}
+
+	if (clusterStart.empty() || clusterStart.front() != 0)
+		clusterStart.insert(clusterStart.begin(), 0);
+
+	size_t const clusterCount = clusterStart.size();
+	if (clusterCount < 2)
+		return;
+
+	clusterStart.push_back(triangleCount);
+
+	glm::vec3 meshCentroid, meshNormal;
+	float meshArea;
+	clusterGeometry(indices.data(), triangleCount, vertices, meshCentroid, meshNormal, meshArea);
+
+	// Sort key: how far the cluster faces away from the mesh centre.
+	// Clusters on the outside, facing outwards, are drawn first.
+	std::vector<float> key(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		glm::vec3 centroid, normal;
+		float area;
+		clusterGeometry(indices.data() + 3 * clusterStart[c], clusterStart[c + 1] - clusterStart[c], vertices, centroid, normal, area);
+
+		float const length = glm::length(normal);
+		key[c] = length > 0.0f ? glm::dot(centroid - meshCentroid, normal / length) : 0.0f;
+	}
+
+	std::vector<size_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::stable_sort(order.begin(), order.end(), [&key](size_t a, size_t b) { return key[a] > key[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (auto const c : order)
+		result.insert(result.end(), indices.begin() + 3 * clusterStart[c], indices.begin() + 3 * clusterStart[c + 1]);
+
+	auto const before = analyzeVertexCache(indices, vertices.size(), kCacheSize);
+	auto const after = analyzeVertexCache(result, vertices.size(), kCacheSize);
+
+	if (after.acmr <= before.acmr * threshold)
+		indices.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<MeshVertex>& vertices, std::vector<uint32_t>& indices)
+{
+	constexpr uint32_t kUnassigned = ~uint32_t(0);
+
+	std::vector<uint32_t> remap(vertices.size(), kUnassigned);
+	std::vector<MeshVertex> result;
+	result.reserve(vertices.size());
+
+	for (auto& index : indices)
+	{
+		if (remap[index] == kUnassigned)
+		{
+			remap[index] = static_cast<uint32_t>(result.size());
+			result.push_back(vertices[index]);
+		}
+
+		index = remap[index];
+	}
+
+	vertices.swap(result);
+}
+
+MeshOptimizationReport optimizeMesh(ObjMesh& mesh)
+{
+	MeshOptimizationReport report;
+	report.before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+	optimizeVertexCache(mesh.indices, mesh.vertices.size());
+	optimizeOverdraw(mesh.indices, mesh.vertices);
+	optimizeVertexFetch(mesh.vertices, mesh.indices);
+
+	report.after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+	return report;
+}
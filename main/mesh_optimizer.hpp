@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+
+#include "ObjModel.hpp"
+
+// Load-time index/vertex reordering for GPU efficiency. All passes keep the
+// set of triangles (and their winding) unchanged.
+
+struct VertexCacheStats
+{
+	// Average cache miss ratio: transformed vertices per triangle (0.5 is
+	// the ideal for large regular meshes, 3.0 the worst case).
+	float acmr = 0.0f;
+	// Average transform to vertex ratio: transformed vertices per unique
+	// vertex (1.0 is ideal).
+	float atvr = 0.0f;
+};
+
+// Simulates a FIFO post-transform cache of the given size.
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize = 16);
+
+// Reorders triangles for post-transform cache locality (Forsyth's linear-speed
+// vertex cache optimization).
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// Reorders the clusters of a cache-optimized index buffer so that outward
+// facing clusters come first, which reduces overdraw from most viewpoints
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"). The new order is only kept if its ACMR is at most threshold
+// times the input's.
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices, float threshold = 1.05f);
+
+// Renumbers vertices in the order they are first referenced and drops unused
+// ones, so vertex fetches walk memory mostly linearly.
+void optimizeVertexFetch(std::vector<MeshVertex>& vertices, std::vector<uint32_t>& indices);
+
+// Runs all of the above. Returns the cache statistics before and after.
+struct MeshOptimizationReport
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+MeshOptimizationReport optimizeMesh(ObjMesh& mesh);
@@ -0,0 +1,352 @@
+#include "mesh_simplifier.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+	// Symmetric 4x4 matrix of the quadric (A, b, c): error(p) = pAp + 2bp + c.
+	struct Quadric
+	{
+		double a00 = 0.0, a11 = 0.0, a22 = 0.0;
+		double a01 = 0.0, a02 = 0.0, a12 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+
+		void addPlane(const glm::vec3& n, double d, double weight)
+		{
+			a00 += weight * n.x * n.x;
+			a11 += weight * n.y * n.y;
+			a22 += weight * n.z * n.z;
+			a01 += weight * n.x * n.y;
+			a02 += weight * n.x * n.z;
+			a12 += weight * n.y * n.z;
+			b0 += weight * n.x * d;
+			b1 += weight * n.y * d;
+			b2 += weight * n.z * d;
+			c += weight * d * d;
+		}
+
+		Quadric& operator+=(const Quadric& q)
+		{
+			a00 += q.a00; a11 += q.a11; a22 += q.a22;
+			a01 += q.a01; a02 += q.a02; a12 += q.a12;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			return *this;
+		}
+
+		double error(const glm::vec3& p) const
+		{
+			double const x = p.x, y = p.y, z = p.z;
+
+			double const rx = a00 * x + a01 * y + a02 * z + b0;
+			double const ry = a01 * x + a11 * y + a12 * z + b1;
+			double const rz = a02 * x + a12 * y + a22 * z + b2;
+
+			// Quadrics are area weighted, so the raw value is not a distance;
+			// it is normalized by the weight in collapseCost().
+			return std::abs(rx * x + ry * y + rz * z + b0 * x + b1 * y + b2 * z + c);
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		float cost;
+	};
+
+	// Every vertex that shares its position with another vertex (attribute
+	// seam) or touches an open edge is locked in place.
+	std::vector<bool> classifyLocked(const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		struct PositionHash
+		{
+			size_t operator()(const glm::vec3& p) const { return std::hash<glm::vec3>()(p); }
+		};
+
+		std::vector<uint32_t> positionId(vertices.size());
+		std::vector<uint32_t> positionUses;
+		{
+			std::unordered_map<glm::vec3, uint32_t, PositionHash> ids;
+			ids.reserve(vertices.size());
+
+			for (size_t v = 0; v < vertices.size(); ++v)
+			{
+				auto const result = ids.emplace(vertices[v].position, static_cast<uint32_t>(ids.size()));
+				positionId[v] = result.first->second;
+			}
+
+			positionUses.assign(ids.size(), 0);
+			for (size_t v = 0; v < vertices.size(); ++v)
+				++positionUses[positionId[v]];
+		}
+
+		std::vector<bool> locked(vertices.size(), false);
+		for (size_t v = 0; v < vertices.size(); ++v)
+			locked[v] = positionUses[positionId[v]] > 1;
+
+		// An edge is open if its reverse does not exist (edges are compared
+		// by position, so seams do not count as borders).
+		std::vector<uint64_t> edges;
+		edges.reserve(indices.size());
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				uint64_t const a = positionId[indices[i + k]];
+				uint64_t const b = positionId[indices[i + (k + 1) % 3]];
+				edges.push_back((a << 32) | b);
+			}
+		}
+
+		std::sort(edges.begin(), edges.end());
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				auto const u = indices[i + k];
+				auto const v = indices[i + (k + 1) % 3];
+				uint64_t const reverse = (uint64_t(positionId[v]) << 32) | positionId[u];
+
+				if (!std::binary_search(edges.begin(), edges.end(), reverse))
+				{
+					locked[u] = true;
+					locked[v] = true;
+				}
+			}
+		}
+
+		return locked;
+	}
+
+	// Would replacing "from" by "to" flip or collapse any remaining
+	// triangle around "from"?
+	bool flipsTriangle(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+		const uint32_t* triangles, uint32_t triangleCount, uint32_t from, uint32_t to)
+	{
+		for (uint32_t i = 0; i < triangleCount; ++i)
+		{
+			auto const* triangle = &indices[3 * triangles[i]];
+
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+				continue;
+
+			glm::vec3 p[3], q[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				p[k] = positions[triangle[k]];
+				q[k] = triangle[k] == from ? positions[to] : p[k];
+			}
+
+			auto const before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			auto const after = glm::cross(q[1] - q[0], q[2] - q[0]);
+
+			float const beforeLength = glm::length(before);
+			if (beforeLength <= 0.0f)
+				continue;
+
+			// Reject flips and slivers whose normal turns by more than ~75
+			// degrees.
+			if (glm::dot(before, after) <= 0.25f * beforeLength * glm::length(after))
+				return true;
+		}
+
+		return false;
+	}
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float targetError, float* resultError)
+{
+	std::vector<uint32_t> result = indices;
+	float maxError = 0.0f;
+
+	size_t const vertexCount = vertices.size();
+
+	if (result.size() <= targetIndexCount || vertexCount == 0)
+	{
+		if (resultError)
+			*resultError = 0.0f;
+		return result;
+	}
+
+	// Work in a unit cube so that errors are relative to the mesh size.
+	glm::vec3 boundsMin = vertices.front().position;
+	glm::vec3 boundsMax = boundsMin;
+	for (auto const& vertex : vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+
+	auto const extents = boundsMax - boundsMin;
+	float const extent = std::max(extents.x, std::max(extents.y, extents.z));
+	float const scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+
+	std::vector<glm::vec3> positions(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		positions[v] = (vertices[v].position - boundsMin) * scale;
+
+	auto const locked = classifyLocked(vertices, indices);
+
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<double> weights(vertexCount, 0.0);
+
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		auto const& p0 = positions[result[i + 0]];
+		auto const& p1 = positions[result[i + 1]];
+		auto const& p2 = positions[result[i + 2]];
+
+		auto normal = glm::cross(p1 - p0, p2 - p0);
+		float const area = glm::length(normal);
+		if (area <= 0.0f)
+			continue;
+
+		normal /= area;
+		double const d = -glm::dot(normal, p0);
+
+		for (int k = 0; k < 3; ++k)
+		{
+			quadrics[result[i + k]].addPlane(normal, d, area);
+			weights[result[i + k]] += area;
+		}
+	}
+
+	double const errorLimit = double(targetError) * double(targetError);
+
+	std::vector<uint32_t> triangleOffset(vertexCount + 1);
+	std::vector<uint32_t> triangleCount(vertexCount);
+	std::vector<uint32_t> vertexTriangles;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+
+	while (result.size() > targetIndexCount)
+	{
+		size_t const triangles = result.size() / 3;
+
+		// Vertex -> triangle adjacency for the current index buffer.
+		std::fill(triangleCount.begin(), triangleCount.end(), 0u);
+		for (auto const index : result)
+			++triangleCount[index];
+
+		triangleOffset[0] = 0;
+		for (size_t v = 0; v < vertexCount; ++v)
+			triangleOffset[v + 1] = triangleOffset[v] + triangleCount[v];
+
+		vertexTriangles.resize(result.size());
+		{
+			std::vector<uint32_t> cursor(triangleOffset.begin(), triangleOffset.end() - 1);
+			for (size_t t = 0; t < triangles; ++t)
+				for (int k = 0; k < 3; ++k)
+					vertexTriangles[cursor[result[3 * t + k]]++] = static_cast<uint32_t>(t);
+		}
+
+		// Candidate collapses along every edge, in both directions where the
+		// source vertex is free to move.
+		collapses.clear();
+
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				auto const u = result[i + k];
+				auto const v = result[i + (k + 1) % 3];
+
+				auto const cost = [&](uint32_t from, uint32_t to) {
+					double const w = weights[from] > 0.0 ? weights[from] : 1.0;
+					return static_cast<float>(quadrics[from].error(positions[to]) / w);
+				};
+
+				if (!locked[u])
+					collapses.push_back({ u, v, cost(u, v) });
+				if (!locked[v])
+					collapses.push_back({ v, u, cost(v, u) });
+			}
+		}
+
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		for (size_t v = 0; v < vertexCount; ++v)
+			remap[v] = static_cast<uint32_t>(v);
+		std::fill(touched.begin(), touched.end(), false);
+
+		// Each collapse removes the (usually two) triangles sharing the edge.
+		size_t const trianglesToRemove = (result.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		size_t applied = 0;
+
+		for (auto const& collapse : collapses)
+		{
+			if (removed >= trianglesToRemove || collapse.cost > errorLimit)
+				break;
+
+			auto const u = collapse.from;
+			auto const v = collapse.to;
+
+			if (touched[u] || touched[v])
+				continue;
+
+			auto const* adjacent = &vertexTriangles[triangleOffset[u]];
+			uint32_t const adjacentCount = triangleCount[u];
+
+			if (flipsTriangle(positions, result, adjacent, adjacentCount, u, v))
+				continue;
+
+			remap[u] = v;
+			quadrics[v] += quadrics[u];
+			weights[v] += weights[u];
+
+			maxError = std::max(maxError, collapse.cost);
+
+			// Lock the whole neighbourhood for the rest of this pass, so
+			// that the adjacency and flip checks above stay valid.
+			for (uint32_t i = 0; i < adjacentCount; ++i)
+			{
+				auto const* triangle = &result[3 * adjacent[i]];
+
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+
+				if (triangle[0] == v || triangle[1] == v || triangle[2] == v)
+					++removed;
+			}
+
+			++applied;
+		}
+
+		if (applied == 0)
+			break;
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			auto const a = remap[result[i + 0]];
+			auto const b = remap[result[i + 1]];
+			auto const c = remap[result[i + 2]];
+
+			if (a == b || b == c || c == a)
+				continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+
+		result.resize(write);
+	}
+
+	if (resultError)
+		*resultError = std::sqrt(maxError);
+
+	return result;
+}
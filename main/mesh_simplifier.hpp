@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+
+#include "ObjModel.hpp"
+
+// Quadric error metric simplification (Garland & Heckbert) by edge collapse.
+// Collapses only ever move a vertex onto one of its neighbours, so the result
+// is a new index buffer over the *same* vertex buffer, and every LOD of a
+// mesh can share one VBO.
+//
+// Vertices on open borders or on attribute seams (several vertices with the
+// same position, e.g. UV seams) are never moved, which keeps silhouettes and
+// texture mapping intact at the cost of a less aggressive reduction on
+// heavily seamed meshes.
+//
+// targetError is relative to the mesh extent (0.01 = 1% of the largest
+// bounding box dimension). Returns the simplified indices; resultError, if
+// given, receives the largest error introduced, in the same relative units.
+std::vector<uint32_t> simplifyMesh(const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float targetError, float* resultError = nullptr);
@@ -0,0 +1,255 @@
+#include "perf_hud.hpp"
+
+#include <algorithm>
+
+#include "renderer.hpp"
+
+#include "imgui/imgui.h"
+#include "imgui/imgui_impl_glfw.h"
+#include "imgui/imgui_impl_opengl3.h"
+
+namespace
+{
+	// Not in the glad build; queried only when the extensions are present.
+	constexpr GLenum kDedicatedVideoMemoryNVX = 0x9047;
+	constexpr GLenum kAvailableVideoMemoryNVX = 0x9049;
+	constexpr GLenum kTextureFreeMemoryATI = 0x87FC;
+
+	float toMiB(size_t bytes)
+	{
+		return static_cast<float>(bytes) / (1024.0f * 1024.0f);
+	}
+
+	void profilerTable()
+	{
+		auto const& results = GpuProfiler::instance().results();
+
+		if (!ImGui::BeginTable("passes", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+			return;
+
+		ImGui::TableSetupColumn("Pass");
+		ImGui::TableSetupColumn("GPU ms");
+		ImGui::TableSetupColumn("CPU ms");
+		ImGui::TableHeadersRow();
+
+		float gpuTotal = 0.0f;
+		float cpuTotal = 0.0f;
+
+		for (auto const& result : results)
+		{
+			ImGui::TableNextRow();
+
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(result.name);
+
+			ImGui::TableNextColumn();
+			if (result.gpuMs >= 0.0f)
+				ImGui::Text("%.3f", result.gpuMs);
+			else
+				ImGui::TextUnformatted("-");
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", result.cpuMs);
+
+			gpuTotal += std::max(result.gpuMs, 0.0f);
+			cpuTotal += result.cpuMs;
+		}
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted("total");
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", gpuTotal);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", cpuTotal);
+
+		ImGui::EndTable();
+	}
+}
+
+PerfHud::~PerfHud()
+{
+	destroy();
+}
+
+void PerfHud::create(GLFWwindow* window)
+{
+	IMGUI_CHECKVERSION();
+	ImGui::CreateContext();
+
+	// No imgui.ini next to the executable.
+	ImGui::GetIO().IniFilename = nullptr;
+
+	ImGui::StyleColorsDark();
+
+	ImGui_ImplGlfw_InitForOpenGL(window, true);
+	ImGui_ImplOpenGL3_Init("#version 430");
+
+	mCreated = true;
+}
+
+void PerfHud::destroy()
+{
+	if (!mCreated)
+		return;
+
+	ImGui_ImplOpenGL3_Shutdown();
+	ImGui_ImplGlfw_Shutdown();
+	ImGui::DestroyContext();
+
+	mCreated = false;
+}
+
+void PerfHud::draw(OpenGLRenderer& renderer, float frameTime)
+{
+	mFrameTimes[mNextFrame] = frameTime * 1000.0f;
+	mNextFrame = (mNextFrame + 1) % kHistory;
+
+	if (!mCreated || !renderer.bShowImGUIWindow)
+		return;
+
+	OGL_PROFILE_SCOPE("hud");
+
+	ImGui_ImplOpenGL3_NewFrame();
+	ImGui_ImplGlfw_NewFrame();
+	ImGui::NewFrame();
+
+	drawWindow(renderer);
+
+	ImGui::Render();
+	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
+
+bool PerfHud::wantsMouse() const
+{
+	return mCreated && ImGui::GetIO().WantCaptureMouse;
+}
+
+void PerfHud::drawWindow(OpenGLRenderer& renderer)
+{
+	ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(360.0f, 0.0f), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowBgAlpha(0.85f);
+
+	if (!ImGui::Begin("Performance (F1)", &renderer.bShowImGUIWindow))
+	{
+		ImGui::End();
+		return;
+	}
+
+	auto& profiler = GpuProfiler::instance();
+
+	// Frame times
+	{
+		float sum = 0.0f;
+		float worst = 0.0f;
+		for (auto time : mFrameTimes)
+		{
+			sum += time;
+			worst = std::max(worst, time);
+		}
+
+		auto const average = sum / kHistory;
+		auto const latest = mFrameTimes[(mNextFrame + kHistory - 1) % kHistory];
+
+		ImGui::Text("Frame %.2f ms (%.0f FPS), average %.2f ms, worst %.2f ms", latest, latest > 0.0f ? 1000.0f / latest : 0.0f, average, worst);
+
+		ImGui::PlotLines("##frametimes", mFrameTimes, static_cast<int>(kHistory), static_cast<int>(mNextFrame),
+			nullptr, 0.0f, std::max(worst, 1000.0f / 30.0f), ImVec2(-1.0f, 60.0f));
+
+		auto const& pacer = renderer.framePacer;
+		ImGui::Text("Waited %.2f ms for the GPU, %.2f ms for the cap", pacer.gpuWait() * 1000.0f, pacer.capWait() * 1000.0f);
+	}
+
+	if (ImGui::CollapsingHeader("Passes", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		if (profiler.enabled())
+			profilerTable();
+		else
+			ImGui::TextUnformatted("Profiler off");
+	}
+
+	if (ImGui::CollapsingHeader("Draws", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		auto const& stats = renderer.renderStats;
+
+		ImGui::Text("Draw calls %u (%u objects multi-drawn)", stats.drawCalls, stats.indirectDraws);
+		ImGui::Text("Triangles %llu", static_cast<unsigned long long>(stats.triangles));
+		ImGui::Text("Queued %u, CPU culled %u", stats.submissions, stats.culled);
+		ImGui::Text("Program changes %u, texture binds %u", stats.programChanges, stats.textureBinds);
+		ImGui::Text("Material uniform updates %u", stats.uniformUpdates);
+	}
+
+	if (ImGui::CollapsingHeader("Memory"))
+	{
+		ImGui::Text("Textures %.1f MiB", toMiB(GLTexture::totalBytes()));
+		ImGui::Text("Mesh arena %.1f MiB", toMiB(renderer.meshArena.bytes()));
+		ImGui::Text("Frame stream %.1f MiB (%u stalls)", toMiB(renderer.frameStream.bytes()), renderer.frameStream.stalls());
+
+		if (glfwExtensionSupported("GL_NVX_gpu_memory_info"))
+		{
+			GLint total = 0, available = 0;
+			glGetIntegerv(kDedicatedVideoMemoryNVX, &total);
+			glGetIntegerv(kAvailableVideoMemoryNVX, &available);
+
+			ImGui::Text("Video memory %.0f of %.0f MiB in use", (total - available) / 1024.0f, total / 1024.0f);
+		}
+		else if (glfwExtensionSupported("GL_ATI_meminfo"))
+		{
+			GLint free[4] = {};
+			glGetIntegerv(kTextureFreeMemoryATI, free);
+
+			ImGui::Text("Video memory %.0f MiB free", free[0] / 1024.0f);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Settings", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		ImGui::Checkbox("Multi-draw indirect", &renderer.useMultiDrawIndirect);
+		ImGui::Checkbox("GPU instance culling", &renderer.useGpuCulling);
+		ImGui::Checkbox("Occlusion culling", &renderer.useOcclusionCulling);
+		ImGui::Checkbox("CPU culling", &renderer.useCpuCulling);
+		ImGui::SliderFloat("Min screen radius", &renderer.minScreenRadius, 0.0f, 8.0f, "%.1f px");
+		ImGui::SliderFloat("LOD pixel error", &renderer.lodPixelError, 0.0f, 8.0f, "%.1f px");
+
+		auto options = renderer.framePacer.options();
+		bool changed = false;
+
+		const char* const modes[] = {
+			presentModeName(PresentMode::VSync),
+			presentModeName(PresentMode::Adaptive),
+			presentModeName(PresentMode::Uncapped),
+			presentModeName(PresentMode::Capped)
+		};
+
+		int mode = static_cast<int>(options.mode);
+		if (ImGui::Combo("Presentation", &mode, modes, IM_ARRAYSIZE(modes)))
+		{
+			options.mode = static_cast<PresentMode>(mode);
+			changed = true;
+		}
+
+		if (options.mode == PresentMode::Capped)
+			changed |= ImGui::SliderFloat("FPS cap", &options.fpsCap, 10.0f, 500.0f, "%.0f");
+
+		int framesInFlight = static_cast<int>(options.maxFramesInFlight);
+		if (ImGui::SliderInt("Frames in flight", &framesInFlight, 0, 4, framesInFlight == 0 ? "driver" : "%d"))
+		{
+			options.maxFramesInFlight = static_cast<unsigned>(framesInFlight);
+			changed = true;
+		}
+
+		if (changed)
+			renderer.framePacer.configure(options);
+
+		bool profiling = profiler.enabled();
+		if (ImGui::Checkbox("GPU profiler", &profiling))
+			profiler.setEnabled(profiling);
+	}
+
+	// Last frame's cost of this window; it is still being drawn this frame.
+	ImGui::Separator();
+	ImGui::Text("HUD: CPU %.3f ms, GPU %.3f ms", std::max(profiler.cpuMs("hud"), 0.0f), std::max(profiler.gpuMs("hud"), 0.0f));
+
+	ImGui::End();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+struct GLFWwindow;
+class OpenGLRenderer;
+
+// Dear ImGui overlay with the frame time history, per-pass GPU/CPU times
+// (see GpuProfiler), draw statistics, memory use and live toggles for the
+// renderer's performance features. Shown while the renderer's
+// bShowImGUIWindow is set (F1 toggles it).
+//
+// The overlay is timed as the profiler scope "hud" and reports its own
+// cost, so it can stay on without skewing the numbers it shows.
+class PerfHud
+{
+public:
+	PerfHud() = default;
+	~PerfHud();
+
+	PerfHud(const PerfHud&) = delete;
+	PerfHud& operator=(const PerfHud&) = delete;
+
+	// Call after the renderer has installed its GLFW callbacks; ImGui's
+	// chain to them.
+	void create(GLFWwindow* window);
+	void destroy();
+
+	// Records the frame time (in seconds) and draws the overlay on top of
+	// the frame. Call after the scene, before swapping buffers.
+	void draw(OpenGLRenderer& renderer, float frameTime);
+
+	// True while the pointer is over the overlay.
+	bool wantsMouse() const;
+
+private:
+	static constexpr size_t kHistory = 240;
+
+	void drawWindow(OpenGLRenderer& renderer);
+
+	bool mCreated = false;
+
+	float mFrameTimes[kHistory] = {};
+	size_t mNextFrame = 0;
+};
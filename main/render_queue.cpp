@@ -0,0 +1,59 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+
+uint64_t RenderQueue::makeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t vao, float depth)
+{
+	constexpr uint32_t kDepthMax = (1u << 24) - 1;
+
+	auto const quantizedDepth = static_cast<uint64_t>(std::min(std::max(depth, 0.0f), 1.0f) * kDepthMax);
+
+	uint64_t const state = (uint64_t(program & 0x3f) << 32) | (uint64_t(material & 0xffff) << 16) | uint64_t(vao & 0xffff);
+	uint64_t key = uint64_t(pass) << 62;
+
+	if (pass == RenderPass::Transparent)
+		key |= ((kDepthMax - quantizedDepth) << 38) | state;
+	else
+		key |= (state << 24) | quantizedDepth;
+
+	return key;
+}
+
+void RenderQueue::sort()
+{
+	size_t const count = mEntries.size();
+	if (count < 2)
+		return;
+
+	mScratch.resize(count);
+
+	Entry* source = mEntries.data();
+	Entry* target = mScratch.data();
+
+	for (unsigned shift = 0; shift < 64; shift += 8)
+	{
+		size_t offsets[256] = {};
+
+		for (size_t i = 0; i < count; ++i)
+			++offsets[(source[i].key >> shift) & 0xff];
+
+		if (offsets[(source[0].key >> shift) & 0xff] == count)
+			continue;
+
+		size_t sum = 0;
+		for (auto& offset : offsets)
+		{
+			size_t const digitCount = offset;
+			offset = sum;
+			sum += digitCount;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			target[offsets[(source[i].key >> shift) & 0xff]++] = source[i];
+
+		std::swap(source, target);
+	}
+
+	if (source != mEntries.data())
+		mEntries.swap(mScratch);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Passes, in execution order.
+enum class RenderPass : uint8_t
+{
+	// Drawn first without depth writes (skybox).
+	Background = 0,
+	// Sorted by state, then front to back for early-z rejection.
+	Opaque = 1,
+	// Blended; sorted back to front.
+	Transparent = 2
+};
+
+// Counters for one execution of the queue.
+struct RenderQueueStats
+{
+	uint32_t submissions = 0;
+	// Draws and instance placements dropped by CPU culling.
+	uint32_t culled = 0;
+	uint32_t drawCalls = 0;
+	// Objects drawn through multi-draw calls (each call counts once in
+	// drawCalls).
+	uint32_t indirectDraws = 0;
+	uint32_t programChanges = 0;
+	uint32_t textureBinds = 0;
+	uint32_t uniformUpdates = 0;
+	// Triangles the GPU drew, instance culling included. From a query a
+	// few frames old, as it is read without waiting.
+	uint64_t triangles = 0;
+};
+
+// Per-frame list of draws, each reduced to a 64-bit sort key plus an index
+// into caller-owned draw data. Sorting the keys groups draws by render state
+// in the order the state is most expensive to change:
+//
+//	opaque/background: | pass:2 | program:6 | material:16 | vao:16 | depth:24 |
+//	transparent:       | pass:2 | ~depth:24 | program:6 | material:16 | vao:16 |
+//
+// Depth is the view distance normalized to [0, 1]; transparent draws put it
+// first (inverted) so that they blend back to front.
+class RenderQueue
+{
+public:
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t item;
+	};
+
+	static uint64_t makeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t vao, float depth);
+
+	static RenderPass pass(uint64_t key) { return static_cast<RenderPass>(key >> 62); }
+
+	void clear() { mEntries.clear(); }
+
+	void submit(uint64_t key, uint32_t item) { mEntries.push_back({ key, item }); }
+
+	// Stable LSD radix sort, 8 bits per pass. Passes over digits that are the
+	// same for every key (e.g., unused high bits) are skipped.
+	void sort();
+
+	const std::vector<Entry>& entries() const { return mEntries; }
+	size_t size() const { return mEntries.size(); }
+
+private:
+	std::vector<Entry> mEntries;
+	std::vector<Entry> mScratch;
+};
@@ -1,5 +1,8 @@
 #include "renderer.hpp"
 
+#include <algorithm>
+#include <memory>
+
 namespace
 {
 	void glfw_callback_error_(int aErrNum, char const* aErrDesc)
@@ -32,6 +35,17 @@ namespace
 			//enableToonShading = !enableToonShading;
 			app->pauseAnimation = !app->pauseAnimation;
 		}
+
+		if (GLFW_KEY_F1 == aKey && GLFW_PRESS == aAction)
+		{
+			app->bShowImGUIWindow = !app->bShowImGUIWindow;
+		}
+
+		// Writes the trace so far, e.g. right after a hitch.
+		if (GLFW_KEY_F2 == aKey && GLFW_PRESS == aAction && Tracer::instance().enabled())
+		{
+			Tracer::instance().write();
+		}
 	}
 
 	void frameBufferResizeCallback(GLFWwindow* inWindow, int width, int height)
@@ -74,7 +88,8 @@ namespace
 	{
 		auto app = reinterpret_cast<OpenGLRenderer*>(glfwGetWindowUserPointer(inWindow));
 
-		if (button == GLFW_MOUSE_BUTTON_2 && action == GLFW_PRESS)
+		// Clicks on the overlay are not meant for the camera.
+		if (button == GLFW_MOUSE_BUTTON_2 && action == GLFW_PRESS && !app->perfHud.wantsMouse())
 		{
 			app->rightMouseButtonDown = true;
 		}
@@ -100,8 +115,144 @@ namespace
 	}
 }
 
-void OpenGLRenderer::startUp()
+namespace
+{
+	// Loose-uniform fallback for programs without the FrameUniforms block.
+	// Works with both ShaderProgram and the learnopengl Shader.
+	template<typename Program>
+	void setFrameUniforms(const Program& program, const FrameUniforms& frame)
+	{
+		program.setMat4("view", frame.view);
+		program.setMat4("projection", frame.projection);
+
+		program.setVec3("lightPosition", glm::vec3(frame.lightPosition));
+		program.setVec3("movingLightPosition", glm::vec3(frame.movingLightPosition));
+		program.setVec3("ambientColor", glm::vec3(frame.ambientColor));
+		program.setVec3("lightColor", glm::vec3(frame.lightColor));
+		program.setVec3("movingLightColor", glm::vec3(frame.movingLightColor));
+		program.setVec3("directionalLightColor", glm::vec3(frame.directionalLightColor));
+		program.setVec3("viewPosition", glm::vec3(frame.viewPosition));
+		program.setFloat("shininess", frame.shininess);
+		program.setBool("enableToonShading", frame.enableToonShading != 0);
+	}
+
+	template<typename Program>
+	void setModelMatrix(const Program& program, bool objectBlock, UniformRing& ring, const glm::mat4& model)
+	{
+		if (objectBlock)
+		{
+			ObjectUniforms object;
+			object.model = model;
+			object.normalMatrix = glm::transpose(glm::inverse(model));
+
+			ring.push(object);
+		}
+		else
+		{
+			program.setMat4("model", model);
+		}
+	}
+
+	// Distance that maps to the far end of the sort key's depth range; the far
+	// plane set in updateUniforms().
+	constexpr float kSortDepthRange = 500.0f;
+
+	// Sort key material bits. Collisions only cost an extra texture bind.
+	uint32_t materialKey(const DrawMaterial& material)
+	{
+		uint32_t const albedo = material.albedo ? material.albedo->id() : 0;
+		uint32_t const specular = material.specular ? material.specular->id() : 0;
+		return (albedo << 8) ^ specular;
+	}
+
+	template<typename Program>
+	uint32_t setMaterial(const Program& program, const DrawMaterial& material, const DrawMaterial* current)
+	{
+		uint32_t updates = 0;
+
+		if (!current || current->color != material.color)
+		{
+			program.setVec3("color", material.color);
+			++updates;
+		}
+
+		if (!current || current->enableSpecular != material.enableSpecular)
+		{
+			program.setBool("enableSpecular", material.enableSpecular);
+			++updates;
+		}
+
+		bool const useSpecularMap = material.specular != nullptr;
+		if (!current || (current->specular != nullptr) != useSpecularMap)
+		{
+			program.setBool("useSpecularMap", useSpecularMap);
+			++updates;
+		}
+
+		return updates;
+	}
+
+	// Bounding sphere after transforming by model; the radius grows with the
+	// largest axis scale.
+	glm::vec4 transformSphere(const glm::mat4& model, const glm::vec4& sphere)
+	{
+		auto const center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+
+		float const scale = std::sqrt(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+			std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])))));
+
+		return glm::vec4(center, sphere.w * scale);
+	}
+
+	glm::vec4 modelBoundingSphere(const Model& model)
+	{
+		bool empty = true;
+		glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+
+		for (auto const& mesh : model.meshes)
+		{
+			for (auto const& vertex : mesh.vertices)
+			{
+				boundsMin = empty ? vertex.Position : glm::min(boundsMin, vertex.Position);
+				boundsMax = empty ? vertex.Position : glm::max(boundsMax, vertex.Position);
+				empty = false;
+			}
+		}
+
+		auto const center = (boundsMin + boundsMax) * 0.5f;
+
+		float radiusSquared = 0.0f;
+		for (auto const& mesh : model.meshes)
+		{
+			for (auto const& vertex : mesh.vertices)
+			{
+				auto const offset = vertex.Position - center;
+				radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+			}
+		}
+
+		return glm::vec4(center, std::sqrt(radiusSquared));
+	}
+
+	ProgramBlocks bindSceneBlocks(GLuint program)
+	{
+		ProgramBlocks blocks;
+		blocks.frame = bindUniformBlock(program, "FrameUniforms", kFrameUniformBinding);
+		blocks.object = bindUniformBlock(program, "ObjectUniforms", kObjectUniformBinding);
+		return blocks;
+	}
+}
+
+void OpenGLRenderer::startUp(const WindowOptions& options)
 {
+	OGL_TRACE_SCOPE("startUp");
+
+#	if defined(GLFW_PLATFORM_NULL)
+	// No window system at all; OSMesa renders into client memory.
+	if (options.contextApi == WindowOptions::ContextApi::OSMesa)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#	endif // ~ GLFW_PLATFORM_NULL
+
 	// Initialize GLFW
 	if (GLFW_TRUE != glfwInit())
 	{
@@ -128,6 +279,14 @@ void OpenGLRenderer::startUp()
 
 	glfwWindowHint(GLFW_DEPTH_BITS, 24);
 
+	if (!options.visible)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	if (options.contextApi == WindowOptions::ContextApi::EGL)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+	else if (options.contextApi == WindowOptions::ContextApi::OSMesa)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+
 #	if !defined(NDEBUG)
 	// When building in debug mode, request an OpenGL debug context. This
 	// enables additional debugging features. However, this can carry extra
@@ -161,7 +320,6 @@ void OpenGLRenderer::startUp()
 
 	// Set up drawing stuff
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1); // V-Sync is on.
 
 	// Initialize GLAD
 	// This will load the OpenGL API. We mustn't make any OpenGL calls before this!
@@ -173,6 +331,9 @@ void OpenGLRenderer::startUp()
 	std::printf("VERSION %s\n", glGetString(GL_VERSION));
 	std::printf("SHADING_LANGUAGE_VERSION %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
 
+	// V-Sync unless overridden (see PresentOptions).
+	framePacer.configure(PresentOptions::defaults());
+
 	// Ddebug output
 #	if !defined(NDEBUG)
 	setup_gl_debug_output();
@@ -198,12 +359,18 @@ void OpenGLRenderer::startUp()
 
 	glViewport(0, 0, iwidth, iheight);
 
+	// After the callbacks above, which ImGui chains to.
+	if (options.visible)
+		perfHud.create(window);
+
 	// Other initialization & loading
 	OGL_CHECKPOINT_ALWAYS();
 }
 
 void OpenGLRenderer::loadShaders()
 {
+	OGL_TRACE_SCOPE("loadShaders");
+
 	defaultShader = ShaderProgram{ {{GL_VERTEX_SHADER, "./assets/shaders/default.vert"},
 							{GL_FRAGMENT_SHADER, "./assets/shaders/default.frag"}} };
 
@@ -219,75 +386,151 @@ void OpenGLRenderer::loadShaders()
 								   {GL_FRAGMENT_SHADER, "./assets/shaders/skybox.frag"}} };
 
 	shader = Shader("./assets/shaders/default.vert", "./assets/shaders/default.frag");
-}
 
-void OpenGLRenderer::loadModels()
-{
-	if (house.load("./assets/models/House.obj"))
-	{
-		house.createBuffers();
-	}
+	// Reads the per-instance model matrix from attributes 3-6 and the frame
+	// data from FrameUniforms.
+	instancedShader = ShaderProgram{ {{GL_VERTEX_SHADER, "./assets/shaders/instanced.vert"},
+									  {GL_FRAGMENT_SHADER, "./assets/shaders/instanced.frag"}} };
 
-	if (ground.load("./assets/models/Plane.obj"))
-	{
-		ground.createBuffers();
-	}
+	glUseProgram(instancedShader.programId());
 
-	if (tree.load("./assets/models/tree.obj"))
-	{
-		tree.createBuffers();
-	}
+	instancedShader.setInt("albedoMap", 0);
+	instancedShader.setInt("secondTexture", 1);
 
-	if (trunk.load("./assets/models/trunk.obj"))
-	{
-		trunk.createBuffers();
-	}
+	// The same, discarding cut-out texels; see DrawMaterial::alphaTest.
+	instancedAlphaTestShader = ShaderProgram{ {{GL_VERTEX_SHADER, "./assets/shaders/instanced.vert"},
+											   {GL_FRAGMENT_SHADER, "./assets/shaders/instanced.frag", "#define ALPHA_TEST\n"}} };
 
-	if (table.load("./assets/models/Table.obj"))
-	{
-		table.createBuffers();
-	}
+	glUseProgram(instancedAlphaTestShader.programId());
+
+	instancedAlphaTestShader.setInt("albedoMap", 0);
+	instancedAlphaTestShader.setInt("secondTexture", 1);
 
-	sphere = createSphere(1.0f, 32, 32);
+	// Same shading; per-draw transforms and colors come from DrawDataBuffer.
+	indirectShader = ShaderProgram{ {{GL_VERTEX_SHADER, "./assets/shaders/indirect.vert"},
+									 {GL_FRAGMENT_SHADER, "./assets/shaders/instanced.frag"}} };
 
-	sphere.createBuffers();
+	glUseProgram(indirectShader.programId());
+
+	indirectShader.setInt("albedoMap", 0);
+	indirectShader.setInt("secondTexture", 1);
+
+	defaultShaderBlocks = bindSceneBlocks(defaultShader.programId());
+	skyboxShaderBlocks = bindSceneBlocks(skyboxShader.programId());
+	bindSceneBlocks(instancedShader.programId());
+	bindSceneBlocks(instancedAlphaTestShader.programId());
+	bindSceneBlocks(indirectShader.programId());
+
+	instanceCuller.create();
+	hiZBuffer.create();
+	shaderBlocks = bindSceneBlocks(shader.ID);
+
+	// Grows on demand (see StreamBuffer) should many props be scattered.
+	frameStream.create(size_t(4) << 20);
+
+	frameUniformRing.create(kFrameUniformBinding, sizeof(FrameUniforms), frameStream);
+	objectUniformRing.create(kObjectUniformBinding, sizeof(ObjectUniforms), frameStream);
+}
 
-	if (dragon.load("./assets/models/dragon.obj"))
+void OpenGLRenderer::loadModels(JobSystem& jobs)
+{
+	OGL_TRACE_SCOPE("loadModels");
+
+	// Parsing and welding run on the workers. The GL buffers are created by
+	// createMeshArena() once every model is loaded and the total size is
+	// known; a failed load leaves the mesh empty.
+	auto loadObj = [&jobs](ObjModel& model, std::string path) {
+		jobs.submit([&model, path] {
+			OGL_TRACE_SCOPE_DETAIL("load model", path.c_str());
+
+			if (!model.load(path))
+			{
+				model.mesh = ObjMesh{};
+			}
+		});
+	};
+
+	loadObj(house, "./assets/models/House.obj");
+	loadObj(ground, "./assets/models/Plane.obj");
+	loadObj(tree, "./assets/models/tree.obj");
+	loadObj(trunk, "./assets/models/trunk.obj");
+	loadObj(table, "./assets/models/Table.obj");
+	loadObj(dragon, "./assets/models/dragon.obj");
+	loadObj(crate, "./assets/models/cube.obj");
+	loadObj(dog, "./assets/models/dog/12228_Dog_v1_L2.obj");
+
+	jobs.submit([this] { sphere = createSphere(1.0f, 32, 32); });
+
+	// The learnopengl Model creates its GL buffers and textures while
+	// importing, so it has to stay on the context thread. It still overlaps
+	// with the jobs above.
 	{
-		dragon.createBuffers();
+		OGL_TRACE_SCOPE_DETAIL("import model", "wooden.obj");
+		wooden = Model("./assets/models/wooden/wooden.obj");
 	}
+	jobs.runCompletions();
 
-	if (crate.load("./assets/models/cube.obj"))
 	{
-		crate.createBuffers();
+		OGL_TRACE_SCOPE_DETAIL("import model", "plants.obj");
+		plants = Model("./assets/models/plants/plants.obj");
 	}
+	jobs.runCompletions();
 
-	if (dog.load("./assets/models/dog/12228_Dog_v1_L2.obj"))
 	{
-		dog.createBuffers();
+		OGL_TRACE_SCOPE_DETAIL("import model", "signature.obj");
+		signature = Model("./assets/models/signature.obj");
 	}
+	jobs.runCompletions();
+}
 
-	wooden = Model("./assets/models/wooden/wooden.obj");
+void OpenGLRenderer::loadTextures(JobSystem& jobs)
+{
+	OGL_TRACE_SCOPE("loadTextures");
 
-	plants = Model("./assets/models/plants/plants.obj");
+	// Decoding runs on the workers; the decoded pixels are then handed to
+	// the streamer, which uploads them over the next frames. With compressed
+	// textures, the workers instead read (or cook) the BC cache, and the much
+	// smaller result is uploaded directly.
+	bool const compressed = useCompressedTextures && compressedTexturesSupported();
 
-	signature = Model("./assets/models/signature.obj");
-}
+	auto loadTexture = [this, &jobs, compressed](GLTexture& texture, std::string path) {
+		if (compressed)
+		{
+			auto image = std::make_shared<CompressedImage>();
+
+			jobs.submit(
+				[image, path] {
+					OGL_TRACE_SCOPE_DETAIL("load compressed texture", path.c_str());
+					loadCompressedImage(path, true, *image);
+				},
+				[&texture, image] { texture.uploadCompressed(*image); }
+			);
+			return;
+		}
 
-void OpenGLRenderer::loadTextures()
-{
-	houseTexture.load("./assets/textures/aiStandardSurface1_baseColor.png");
-	groundTexture.load("./assets/textures/CartoonGrass.jpg");
+		auto image = std::make_shared<ImageData>();
+
+		jobs.submit(
+			[image, path] {
+				OGL_TRACE_SCOPE_DETAIL("decode texture", path.c_str());
+				decodeImage(path, true, *image);
+			},
+			[this, &texture, image] { textureStreamer.enqueue(texture, std::move(*image)); }
+		);
+	};
 
-	treeTexture.load("./assets/textures/tree.png");
-	trunkTexture.load("./assets/textures/trunk.png");
-	defaultTexture.load("./assets/textures/default.png");
+	loadTexture(houseTexture, "./assets/textures/aiStandardSurface1_baseColor.png");
+	loadTexture(groundTexture, "./assets/textures/CartoonGrass.jpg");
 
-	crateDiffuseTexture.load("./assets/textures/CrateDiffuse.png");
-	crateSpecularTexture.load("./assets/textures/CrateSpecular.png");
-	signatureTexture.load("./assets/textures/signature.jpg");
+	loadTexture(treeTexture, "./assets/textures/tree.png");
+	loadTexture(trunkTexture, "./assets/textures/trunk.png");
+	loadTexture(defaultTexture, "./assets/textures/default.png");
 
-	tableTexture.load("./assets/textures/Albedo_4K__slxoejhp.jpg");
+	loadTexture(crateDiffuseTexture, "./assets/textures/CrateDiffuse.png");
+	loadTexture(crateSpecularTexture, "./assets/textures/CrateSpecular.png");
+	loadTexture(signatureTexture, "./assets/textures/signature.jpg");
+
+	loadTexture(tableTexture, "./assets/textures/Albedo_4K__slxoejhp.jpg");
 
 	std::vector<std::string> faces =
 	{
@@ -299,7 +542,34 @@ void OpenGLRenderer::loadTextures()
 		"./assets/textures/skybox/CloudyCrown_Midday_Back.png"
 	};
 
-	cubemapTexture.loadCubemap(faces);
+	// Each face is decoded by its own job; the cubemap is uploaded once the
+	// last one has finished. Completions all run on this thread, so the
+	// counter needs no synchronization.
+	struct CubemapFaces
+	{
+		std::vector<ImageData> images;
+		size_t remaining;
+	};
+
+	auto cubemap = std::make_shared<CubemapFaces>();
+	cubemap->images.resize(faces.size());
+	cubemap->remaining = faces.size();
+
+	for (size_t i = 0; i < faces.size(); ++i)
+	{
+		jobs.submit(
+			[cubemap, i, path = faces[i]] {
+				OGL_TRACE_SCOPE_DETAIL("decode texture", path.c_str());
+				decodeImage(path, false, cubemap->images[i]);
+			},
+			[this, cubemap] {
+				if (--cubemap->remaining == 0)
+				{
+					textureStreamer.enqueueCubemap(cubemapTexture, std::move(cubemap->images));
+				}
+			}
+		);
+	}
 }
 
 void OpenGLRenderer::loadGeometry()
@@ -358,13 +628,66 @@ void OpenGLRenderer::loadGeometry()
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 }
 
+void OpenGLRenderer::createMeshArena()
+{
+	OGL_TRACE_SCOPE("createMeshArena");
+
+	ObjModel* const models[] = { &house, &ground, &tree, &trunk, &table, &sphere, &dragon, &crate, &dog };
+
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+
+	for (auto model : models)
+	{
+		vertexCount += model->mesh.vertices.size();
+		indexCount += model->mesh.indices.size() + model->mesh.lodIndices.size();
+	}
+
+	meshArena.create(vertexCount, indexCount);
+
+	for (auto model : models)
+	{
+		if (model->mesh.vertices.empty())
+			continue;
+
+		if (!model->createBuffers(meshArena))
+		{
+			model->createBuffers();
+		}
+	}
+
+	indirectDraws.create(meshArena, frameStream);
+
+	// Placements that submitDog() and submitTrees() rebuild every frame.
+	sphere.setInstanceStream(&frameStream);
+	tree.setInstanceStream(&frameStream);
+	trunk.setInstanceStream(&frameStream);
+}
+
 void OpenGLRenderer::loadResources()
 {
-	loadShaders();
-	loadModels();
-	loadTextures();
+	OGL_TRACE_SCOPE("loadResources");
+
+	auto const start = Clock::now();
+
+	{
+		JobSystem jobs;
 
-	loadGeometry();
+		// Queue all CPU-side work first, so that the workers are busy while
+		// the context thread compiles shaders and imports the assimp models.
+		loadTextures(jobs);
+		loadModels(jobs);
+
+		loadShaders();
+		loadGeometry();
+
+		jobs.waitAll();
+
+		createMeshArena();
+	}
+
+	auto const elapsed = std::chrono::duration_cast<Secondsf>(Clock::now() - start).count();
+	std::printf("Resources loaded in %.1f ms\n", elapsed * 1000.0f);
 }
 
 ObjModel OpenGLRenderer::createSphere(float radius, uint32_t sliceCount, uint32_t stackCount)
@@ -466,9 +789,19 @@ ObjModel OpenGLRenderer::createSphere(float radius, uint32_t sliceCount, uint32_
 		model.mesh.indices.push_back(baseIndex + i + 1);
 	}
 
+	model.mesh.computeBounds();
+	model.generateLods();
+
 	return model;
 }
 
+void OpenGLRenderer::updateTextureStreaming()
+{
+	OGL_TRACE_SCOPE("updateTextureStreaming");
+
+	textureStreamer.update();
+}
+
 void OpenGLRenderer::updateInput(float deltaTime)
 {
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
@@ -514,440 +847,909 @@ void OpenGLRenderer::updateInput(float deltaTime)
 		camera.SetNormalSpeed();
 	}
 
+	// The dog itself moves in updateSimulation().
+	sceneInput.dogDirection = 0.0f;
+
 	if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
 	{
-		dogOffset += 0.02f;
-		isMoving = true;
+		sceneInput.dogDirection += 1.0f;
 	}
 
 	if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
 	{
-		dogOffset -= 0.02f;
-		isMoving = true;
+		sceneInput.dogDirection -= 1.0f;
 	}
 }
 
-void OpenGLRenderer::updateTreeRotation()
+void OpenGLRenderer::updateSimulation(float frameTime)
 {
-	treeRotation += 0.1f * treeRotationDirection;
+	// The light orbits while pauseAnimation is set (toggled with space).
+	sceneInput.movingLightRotation = pauseAnimation ? movingLightRotation : 0.0f;
+
+	simulationClock.advance(frameTime);
 
-	if (treeRotation > 5.0f || treeRotation < -5.0f)
+	while (simulationClock.step())
 	{
-		treeRotationDirection = -treeRotationDirection;
+		previousAnimation = animation;
+		stepAnimation(animation, sceneInput, simulationClock.stepSize());
 	}
+
+	renderedAnimation = interpolate(previousAnimation, animation, simulationClock.alpha());
 }
 
-void OpenGLRenderer::drawDog()
+void OpenGLRenderer::submitDog()
 {
-	// Torso
-	trunkTexture.use();
+	submitProfileName = "dog";
 
-	glm::vec3 translation = { 0.0f, 1.5f, dogOffset };
-	glm::vec3 scale = { 0.6f, 0.6f, 1.2f };
+	DogPose pose;
+	pose.legsAngle = renderedAnimation.legsAngle;
+	pose.tailHorizontalAngle = tailHorizontalAngle;
+	pose.tailVerticalAngle = tailVerticalAngle;
+	pose.tailWiggleAngle = renderedAnimation.tailWiggleAngle;
 
-	auto model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::scale(model, scale);
+	instanceTransforms.clear();
+	instanceColors.clear();
+
+	buildDogInstances(glm::translate(glm::mat4(1.0f), { 0.0f, 0.0f, renderedAnimation.dogOffset }), pose, instanceTransforms, instanceColors);
+
+	// The rest of the herd shares the pose.
+	for (auto const& root : herd)
+	{
+		buildDogInstances(root, pose, instanceTransforms, instanceColors);
+	}
 
-	defaultShader.setMat4("model", model);
+	cullPlacements(sphere, instanceTransforms, &instanceColors);
 
-	sphere.draw();
+	sphere.setInstances(instanceTransforms, instanceColors);
 
-	// Legs
-	translation = { -0.3f, 0.75f, -0.6f + dogOffset };
-	scale = { 0.5f * 0.3f, 2.0f * 0.3f, 0.5f * 0.3f };
+	DrawMaterial material;
+	material.albedo = &trunkTexture;
 
-	model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::rotate(model, glm::radians(legsAngle), { 1.0f, 0.0f, 0.0f });
-	model = glm::scale(model, scale);
+	submitInstanced(sphere, material);
+}
 
-	defaultShader.setMat4("model", model);
+void OpenGLRenderer::addDog(const glm::vec3& position, float yaw)
+{
+	auto root = glm::translate(glm::mat4(1.0f), position);
+	herd.push_back(glm::rotate(root, glm::radians(yaw), { 0.0f, 1.0f, 0.0f }));
+}
 
-	sphere.draw();
+void OpenGLRenderer::scatterDogs(size_t count, float radius, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(-radius, radius);
+	std::uniform_real_distribution<float> yaw(0.0f, 360.0f);
 
-	translation = { 0.3f, -2.5f * 0.3f + 1.5f, -0.6f + dogOffset };
-	scale = { 0.5f * 0.3f, 0.6f, 0.5f * 0.3f };
+	for (size_t i = 0; i < count; ++i)
+	{
+		addDog({ position(random), 0.0f, position(random) }, yaw(random));
+	}
+}
 
-	model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::rotate(model, glm::radians(-legsAngle), { 1.0f, 0.0f, 0.0f });
-	model = glm::scale(model, scale);
+void OpenGLRenderer::submitDragon()
+{
+	submitProfileName = "dragon";
+
+	DrawMaterial material;
+	material.albedo = &defaultTexture;
 
-	defaultShader.setMat4("model", model);
+	glm::vec3 translation = { -2.0f, 2.5f, 15.0f };
+
+	auto model = glm::translate(glm::mat4(1.0f), translation);
+	model = glm::scale(model, glm::vec3(0.5f));
 
-	sphere.draw();
+	submitMesh(dragon, model, material);
 
-	translation = { 0.3f, -2.5f * 0.3f + 1.5f, 2.0 * 0.3f + dogOffset };
-	scale = { 0.5f * 0.3f, 0.6f, 0.5f * 0.3f };
+	translation = { 1.0f, 2.5f, 15.0f };
 
 	model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::rotate(model, glm::radians(legsAngle), { 1.0f, 0.0f, 0.0f });
-	model = glm::scale(model, scale);
+	model = glm::scale(model, glm::vec3(0.5f));
 
-	defaultShader.setMat4("model", model);
+	material.enableSpecular = true;
 
-	sphere.draw();
+	submitMesh(dragon, model, material);
+}
 
-	translation = { -0.3f, -2.5f * 0.3f + 1.5f, 0.6 + dogOffset };
-	scale = { 0.5f * 0.3f, 0.6f, 0.5f * 0.3f };
+void OpenGLRenderer::submitMovingLight()
+{
+	submitProfileName = "lights";
 
-	model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::rotate(model, glm::radians(-legsAngle), { 1.0f, 0.0f, 0.0f });
-	model = glm::scale(model, scale);
+	auto model = glm::translate(glm::mat4(1.0f), renderedAnimation.movingLightPosition);
+	model = glm::scale(model, { 0.5f, 0.5f, 0.5f });
 
-	defaultShader.setMat4("model", model);
+	DrawMaterial material;
+	material.albedo = &defaultTexture;
+	material.color = movingLightColor;
 
-	sphere.draw();
+	submitMesh(sphere, model, material);
 
-	// Tail
-	model = glm::translate(glm::mat4(1.0f), { 0.0f, 0.0f + 1.5f, -3.8f * 0.3f + dogOffset });
-	model = glm::rotate(model, glm::radians(-30.0f), { 1.0f, 0.0f, 0.0f });
-	model = glm::rotate(model, glm::radians(tailVerticalAngle), { 1.0f, 0.0f, 0.0f });
-	model = glm::rotate(model, glm::radians(tailHorizontalAngle), { 0.0f, 1.0f, 0.0f });
-	model = glm::rotate(model, glm::radians(tailWiggleAngle), { 0.0f, 1.0f, 0.0f });
-	model = glm::scale(model, { 0.5f * 0.3f, 0.5f * 0.3f, 1.8f * 0.3f });
+	model = glm::translate(glm::mat4(1.0f), lightPosition);
 
-	defaultShader.setMat4("model", model);
+	material.color = lightColor;
 
-	sphere.draw();
+	submitMesh(sphere, model, material);
+}
 
-	// Head
-	model = glm::translate(glm::mat4(1.0f), { 0.0f, 2.5f * 0.3f + 1.5f, 3.0f * 0.3f + dogOffset });
-	model = glm::scale(model, { 1.5f * 0.3f, 1.55f * 0.3f, 1.6f * 0.3f });
+void OpenGLRenderer::submitCrates()
+{
+	if (crateInstances.empty())
+		return;
 
-	defaultShader.setMat4("model", model);
+	submitProfileName = "crates";
 
-	sphere.draw();
+	// Crates do not move; only re-upload when placements were added, or
+	// every frame when they are culled on the CPU.
+	bool const cpuCulled = useCpuCulling && !useGpuCulling;
 
-	// Nose
-	model = glm::translate(glm::mat4(1.0f), { 0.0f, 2.2f * 0.3f + 1.5f, 4.2f * 0.3f + dogOffset });
-	model = glm::scale(model, { 0.8f * 0.3f, 0.5f * 0.3f, 1.5f * 0.3f });
+	if (crateInstancesDirty || cpuCulled)
+	{
+		instanceTransforms.clear();
+		for (auto const& instance : crateInstances)
+		{
+			auto model = glm::translate(glm::mat4(1.0f), instance.translation);
+			instanceTransforms.push_back(glm::scale(model, instance.scale));
+		}
 
-	defaultShader.setMat4("model", model);
+		cullPlacements(crate, instanceTransforms);
 
-	sphere.draw();
+		crate.setInstances(instanceTransforms);
+		crateInstancesDirty = cpuCulled;
+	}
 
-	// Ear
-	model = glm::translate(glm::mat4(1.0f), { -0.8f * 0.3f, 3.8f * 0.3f + 1.5f, 2.6f * 0.3f + dogOffset });
-	model = glm::scale(model, { 0.5f * 0.3f, 0.3f, 0.5f * 0.3f });
+	DrawMaterial material;
+	material.albedo = &crateDiffuseTexture;
+	material.specular = &crateSpecularTexture;
+	material.enableSpecular = true;
 
-	defaultShader.setMat4("model", model);
+	submitInstanced(crate, material);
+}
 
-	sphere.draw();
+void OpenGLRenderer::submitTrees()
+{
+	if (treeInstances.empty())
+		return;
 
-	model = glm::translate(glm::mat4(1.0f), { 0.8f * 0.3f, 3.8f * 0.3f + 1.5f, 2.6f * 0.3f + dogOffset });
-	model = glm::scale(model, { 0.5f * 0.3f, 0.3f, 0.5f * 0.3f });
+	submitProfileName = "trees";
 
-	defaultShader.setMat4("model", model);
+	// The sway rotation changes every frame, so the transforms are rebuilt
+	// and uploaded each time (one buffer upload per mesh).
+	instanceTransforms.clear();
+	for (auto const& instance : treeInstances)
+	{
+		auto model = glm::translate(glm::mat4(1.0f), instance.translation);
+		model = glm::rotate(model, glm::radians(renderedAnimation.treeRotation), glm::vec3(0.0f, 0.0f, 1.0f));
 
-	sphere.draw();
+		instanceTransforms.push_back(glm::scale(model, instance.scale));
+	}
 
-	model = glm::translate(glm::mat4(1.0f), { 0.5f * 0.3f, 3.0f * 0.3f + 1.5f, 4.4f * 0.3f + dogOffset });
-	model = glm::scale(model, { 0.25f * 0.3f, 0.25f * 0.3f, 0.25f * 0.3f });
+	visibleTransforms = instanceTransforms;
+	cullPlacements(tree, visibleTransforms);
+	tree.setInstances(visibleTransforms);
 
-	defaultShader.setMat4("model", model);
-	defaultShader.setVec3("color", { 0.0f, 0.0f, 0.0f });
+	visibleTransforms = instanceTransforms;
+	cullPlacements(trunk, visibleTransforms);
+	trunk.setInstances(visibleTransforms);
 
-	sphere.draw();
+	DrawMaterial material;
+	material.albedo = &treeTexture;
+	material.alphaTest = true;
 
-	model = glm::translate(glm::mat4(1.0f), { -0.5f * 0.3f, 3.0f * 0.3f + 1.5f, 4.4f * 0.3f + dogOffset });
-	model = glm::scale(model, { 0.25f * 0.3f, 0.25f * 0.3f, 0.25f * 0.3f });
+	submitInstanced(tree, material);
 
-	defaultShader.setMat4("model", model);
-	defaultShader.setVec3("color", { 0.0f, 0.0f, 0.0f });
+	material.albedo = &trunkTexture;
+	material.alphaTest = false;
 
-	sphere.draw();
+	submitInstanced(trunk, material);
+}
 
-	defaultShader.setVec3("color", { 1.0f, 1.0f, 1.0f });
+void OpenGLRenderer::addTreeInstance(const glm::vec3& translation, const glm::vec3& scale)
+{
+	treeInstances.push_back({ translation, scale });
 }
 
-void OpenGLRenderer::drawDragon()
+void OpenGLRenderer::addCrateInstance(const glm::vec3& translation, const glm::vec3& scale)
 {
-	defaultTexture.use();
+	crateInstances.push_back({ translation, scale });
+	crateInstancesDirty = true;
+}
 
-	glm::vec3 translation = { -2.0f, 2.5f, 15.0f };
+void OpenGLRenderer::scatterProps(size_t treeCount, size_t crateCount, float radius, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(-radius, radius);
+	std::uniform_real_distribution<float> size(0.75f, 1.25f);
+
+	for (size_t i = 0; i < treeCount; ++i)
+	{
+		float const s = 2.0f * size(random);
+		addTreeInstance({ position(random), 0.0f, position(random) }, { s, s, s });
+	}
+
+	for (size_t i = 0; i < crateCount; ++i)
+	{
+		float const s = size(random);
+		addCrateInstance({ position(random), s, position(random) }, { s, s, s });
+	}
+}
+
+void OpenGLRenderer::submitTable(const glm::vec3& translation, const glm::vec3& scale)
+{
+	submitProfileName = "table";
 
 	auto model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::scale(model, glm::vec3(0.5f));
+	model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
-	defaultShader.setMat4("model", model);
+	model = glm::scale(model, scale);
 
-	dragon.draw();
+	DrawMaterial material;
+	material.albedo = &tableTexture;
 
-	translation = { 1.0f, 2.5f, 15.0f };
+	submitMesh(table, model, material);
+}
 
-	model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::scale(model, glm::vec3(0.5f));
+void OpenGLRenderer::drawModel(const ObjModel& objModel, const glm::vec3& translation, const glm::vec3& scale)
+{
+	auto model = glm::translate(glm::mat4(1.0f), translation);
+	model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
-	defaultShader.setMat4("model", model);
+	model = glm::scale(model, scale);
 
-	defaultShader.setBool("enableSpecular", true);
+	drawMesh(objModel, model);
+}
 
-	dragon.draw();
+void OpenGLRenderer::drawMesh(const ObjModel& objModel, const glm::mat4& model)
+{
+	setModelMatrix(defaultShader, defaultShaderBlocks.object, objectUniformRing, model * objModel.decodeMatrix());
 
-	defaultShader.setBool("enableSpecular", false);
+	objModel.draw(objModel.selectLod(model, camera.Position, projection, static_cast<float>(windowHeight), lodPixelError));
 }
 
-void OpenGLRenderer::drawMovingLight()
+void OpenGLRenderer::submit(DrawItem item, RenderPass pass, float depth)
 {
-	defaultTexture.use();
+	item.pass = pass;
+	item.depth = depth;
+	item.profileName = submitProfileName;
 
-	auto rx0 = 0.0f;
-	auto rz0 = 20.0f;
+	drawItems.push_back(item);
+}
 
-	auto x = movingLightPosition.x;
-	auto z = movingLightPosition.z;
+ScreenSizeCull OpenGLRenderer::screenSizeCull() const
+{
+	ScreenSizeCull screenSize;
+	screenSize.projectionScale = projection[1][1] * static_cast<float>(windowHeight) * 0.5f;
+	screenSize.minRadius = minScreenRadius;
+	return screenSize;
+}
 
-	auto a = glm::radians(movingLightRotation);
+void OpenGLRenderer::queueVisibleItems()
+{
+	// Items without bounds are always visible; the rest are tested as one
+	// batch.
+	cullSpheresBatch.clear();
 
-	auto x0 = (x - rx0) * std::cos(a) - (z - rz0) * std::sin(a) + rx0;
-	auto z0 = (x - rx0) * std::sin(a) + (z - rz0) * std::cos(a) + rz0;
+	if (useCpuCulling)
+	{
+		for (auto const& item : drawItems)
+		{
+			if (item.bounds.w >= 0.0f)
+				cullSpheresBatch.add(item.bounds);
+		}
+	}
+
+	cullVisibility.resize(cullSpheresBatch.size());
+	auto const visibleCount = cullSpheres(frustum, cullSpheresBatch, screenSizeCull(), cullVisibility.data());
+
+	renderStats.culled += static_cast<uint32_t>(cullSpheresBatch.size() - visibleCount);
+
+	size_t tested = 0;
 
-	if (pauseAnimation)
+	for (size_t i = 0; i < drawItems.size(); ++i)
 	{
-		movingLightPosition.x = x0;
-		movingLightPosition.z = z0;
+		auto const& item = drawItems[i];
+
+		if (useCpuCulling && item.bounds.w >= 0.0f && !cullVisibility[tested++])
+			continue;
+
+		uint32_t vao = item.mesh ? item.mesh->mesh.VAO : 0;
+		if (item.program == SceneProgram::Indirect)
+			vao = meshArena.vao();
+
+		uint64_t const key = RenderQueue::makeKey(item.pass, static_cast<uint32_t>(item.program), materialKey(item.material), vao, item.depth);
+
+		renderQueue.submit(key, static_cast<uint32_t>(i));
 	}
+}
 
-	auto model = glm::translate(glm::mat4(1.0f), movingLightPosition);
-	model = glm::scale(model, { 0.5f, 0.5f, 0.5f });
+void OpenGLRenderer::cullPlacements(const ObjModel& objModel, std::vector<glm::mat4>& transforms, std::vector<glm::vec4>* colors)
+{
+	// The GPU pass culls them after upload instead.
+	if (!useCpuCulling || useGpuCulling)
+		return;
 
-	defaultShader.setMat4("model", model);
-	defaultShader.setVec3("color", movingLightColor);
+	cullSpheresBatch.clear();
+	for (auto const& transform : transforms)
+		cullSpheresBatch.add(transformSphere(transform, objModel.mesh.boundingSphere));
 
-	sphere.draw();
+	cullVisibility.resize(transforms.size());
+	cullSpheres(frustum, cullSpheresBatch, screenSizeCull(), cullVisibility.data());
 
-	defaultShader.setVec3("color", glm::vec3(1.0f));
+	size_t kept = 0;
 
-	model = glm::translate(glm::mat4(1.0f), lightPosition);
+	for (size_t i = 0; i < transforms.size(); ++i)
+	{
+		if (!cullVisibility[i])
+			continue;
+
+		transforms[kept] = transforms[i];
+		if (colors && i < colors->size())
+			(*colors)[kept] = (*colors)[i];
+
+		++kept;
+	}
 
-	defaultShader.setMat4("model", model);
-	defaultShader.setVec3("color", lightColor);
+	renderStats.culled += static_cast<uint32_t>(transforms.size() - kept);
 
-	sphere.draw();
+	transforms.resize(kept);
+	if (colors && colors->size() > kept)
+		colors->resize(kept);
 }
 
-void OpenGLRenderer::drawCrate()
+void OpenGLRenderer::submitSkybox()
 {
-	glActiveTexture(GL_TEXTURE0);
+	submitProfileName = "skybox";
+
+	DrawItem item;
+	item.kind = DrawItem::Kind::Skybox;
+	item.program = SceneProgram::Skybox;
+	item.material.albedo = &cubemapTexture;
 
-	crateDiffuseTexture.use();
+	submit(item, RenderPass::Background, 0.0f);
+}
+
+void OpenGLRenderer::submitMesh(const ObjModel& objModel, const glm::mat4& model, const DrawMaterial& material)
+{
+	// Meshes that did not fit into the arena keep buffers of their own.
+	bool const inArena = objModel.mesh.VBO == meshArena.vertexBuffer();
+
+	DrawItem item;
+	item.kind = DrawItem::Kind::Mesh;
+	item.program = useMultiDrawIndirect && inArena ? SceneProgram::Indirect : SceneProgram::Default;
+	item.mesh = &objModel;
+	item.material = material;
+	item.transform = model;
+	item.bounds = transformSphere(model, objModel.mesh.boundingSphere);
+
+	submit(item, RenderPass::Opaque, glm::distance(camera.Position, glm::vec3(model[3])) / kSortDepthRange);
+}
 
-	glActiveTexture(GL_TEXTURE1);
+void OpenGLRenderer::submitInstanced(ObjModel& objModel, const DrawMaterial& material)
+{
+	if (objModel.instanceCount() == 0)
+		return;
 
-	crateSpecularTexture.use();
+	objModel.setInstanceCulling(useGpuCulling);
 
-	glm::vec3 translation = { -5.0f, 1.0f, 20.0f };
+	DrawItem item;
+	item.kind = DrawItem::Kind::Instanced;
+	item.program = material.alphaTest ? SceneProgram::InstancedAlphaTest : SceneProgram::Instanced;
+	item.mesh = &objModel;
+	item.material = material;
+	item.lod = objModel.selectInstancedLod(camera.Position, projection, static_cast<float>(windowHeight), lodPixelError);
 
-	auto model = glm::translate(glm::mat4(1.0f), translation);
+	// Instances are spread out; sort the batch as if it were at the camera.
+	submit(item, RenderPass::Opaque, 0.0f);
+}
 
-	defaultShader.setMat4("model", model);
+void OpenGLRenderer::submitModel(Model& model, const glm::mat4& transform, RenderPass pass)
+{
+	DrawItem item;
+	item.kind = DrawItem::Kind::Model;
+	item.program = SceneProgram::Model;
+	item.model = &model;
+	item.transform = transform;
 
-	defaultShader.setBool("enableSpecular", true);
-	defaultShader.setBool("useSpecularMap", true);
+	auto bounds = modelBounds.find(&model);
+	if (bounds == modelBounds.end())
+		bounds = modelBounds.emplace(&model, modelBoundingSphere(model)).first;
 
-	crate.draw();
+	item.bounds = transformSphere(transform, bounds->second);
 
-	defaultShader.setBool("enableSpecular", false);
-	defaultShader.setBool("useSpecularMap", false);
+	submit(item, pass, glm::distance(camera.Position, glm::vec3(transform[3])) / kSortDepthRange);
 }
 
-void OpenGLRenderer::drawTree(const glm::vec3& translation, const glm::vec3& scale)
+void OpenGLRenderer::submitStaticScene()
 {
-	treeTexture.use();
+	submitSkybox();
 
-	auto model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::rotate(model, glm::radians(treeRotation), glm::vec3(0.0f, 0.0f, 1.0f));
+	submitTrees();
 
-	model = glm::scale(model, scale);
+	submitTable({ 0.0f, 2.5f, 15.0f }, { 1.0f, 1.0f, 1.0f });
+
+	auto model = glm::scale(glm::mat4(1.0f), glm::vec3(4.0f, 4.0f, 4.0f));
+
+	model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	submitProfileName = "house/ground";
 
-	defaultShader.setMat4("model", model);
+	DrawMaterial material;
+	material.albedo = &houseTexture;
 
-	tree.draw();
+	submitMesh(house, model, material);
+
+	material.albedo = &groundTexture;
+
+	submitMesh(ground, model, material);
+
+	submitProfileName = "wooden";
+
+	submitModel(wooden, glm::mat4(1.0f), RenderPass::Opaque);
+
+	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 5.0f));
+	model = glm::scale(model, glm::vec3(0.01f));
+
+	submitProfileName = "plants";
+
+	submitModel(plants, model, RenderPass::Transparent);
+
+	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 10.0f, 10.0f));
+	model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	model = glm::scale(model, glm::vec3(5.0f, 5.0f, 5.0f));
 
-	trunkTexture.use();
+	submitProfileName = "signature";
 
-	trunk.draw();
+	submitModel(signature, model, RenderPass::Opaque);
 }
 
-void OpenGLRenderer::drawTable(const glm::vec3& translation, const glm::vec3& scale)
+void OpenGLRenderer::useProgram(SceneProgram program)
 {
-	tableTexture.use();
+	switch (program)
+	{
+	case SceneProgram::Skybox:
+		skyboxShader.use();
+		break;
+	case SceneProgram::Default:
+		defaultShader.use();
+		break;
+	case SceneProgram::Instanced:
+		instancedShader.use();
+		break;
+	case SceneProgram::InstancedAlphaTest:
+		instancedAlphaTestShader.use();
+		break;
+	case SceneProgram::Indirect:
+		indirectShader.use();
+		break;
+	case SceneProgram::Model:
+		shader.use();
+		break;
+	default:
+		break;
+	}
+}
 
-	auto model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+void OpenGLRenderer::cullInstances()
+{
+	auto const* hiZ = useOcclusionCulling && hiZBuffer.valid() ? &hiZBuffer : nullptr;
 
-	model = glm::scale(model, scale);
+	bool culled = false;
 
-	defaultShader.setMat4("model", model);
+	for (auto const& item : drawItems)
+	{
+		if (item.kind == DrawItem::Kind::Instanced && item.mesh->instanceCulling())
+		{
+			instanceCuller.cull(*item.mesh, frustum, item.lod, hiZ);
+			culled = true;
+		}
+	}
 
-	table.draw();
+	if (culled)
+		instanceCuller.finish();
 }
 
-void OpenGLRenderer::drawModel(const ObjModel& objModel, const glm::vec3& translation, const glm::vec3& scale)
+void OpenGLRenderer::drawDisoccludedInstances()
 {
-	auto model = glm::translate(glm::mat4(1.0f), translation);
-	model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	if (!useOcclusionCulling)
+		return;
 
-	model = glm::scale(model, scale);
+	auto const gpuCulled = [](const DrawItem& item) {
+		return item.kind == DrawItem::Kind::Instanced && item.mesh->instanceCulling();
+	};
+
+	// Nothing reads the pyramid while the placements are culled on the CPU.
+	if (std::none_of(drawItems.begin(), drawItems.end(), gpuCulled))
+		return;
+
+	OGL_PROFILE_SCOPE("occlusion");
+
+	// Also what the next frame's early pass tests against.
+	hiZBuffer.build(windowWidth, windowHeight, projection * camera.GetViewMatrix());
+
+	for (auto const& item : drawItems)
+	{
+		if (gpuCulled(item))
+			instanceCuller.cullDisoccluded(*item.mesh, hiZBuffer);
+	}
+
+	instanceCuller.finish();
 
-	defaultShader.setMat4("model", model);
+	for (auto const& item : drawItems)
+	{
+		if (!gpuCulled(item))
+			continue;
+
+		auto& program = item.program == SceneProgram::InstancedAlphaTest ? instancedAlphaTestShader : instancedShader;
+		program.use();
+
+		if (item.material.specular)
+		{
+			glActiveTexture(GL_TEXTURE1);
+			item.material.specular->use();
+		}
+
+		glActiveTexture(GL_TEXTURE0);
+		item.material.albedo->use();
 
-	objModel.draw();
+		setMaterial(program, item.material, nullptr);
+
+		item.mesh->drawDisoccludedInstances();
+		++renderStats.drawCalls;
+	}
 }
 
-void OpenGLRenderer::drawModel()
+void OpenGLRenderer::executeRenderQueue()
 {
-	// draw skybox as last
-	//glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-	glDepthMask(GL_FALSE);
-	skyboxShader.use();
+	renderStats.submissions = static_cast<uint32_t>(renderQueue.size());
 
-	// remove translation from the view matrix
-	auto view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-	skyboxShader.setMat4("view", view);
+	auto currentPass = RenderPass::Opaque;
+	auto currentProgram = SceneProgram::Count;
 
-	glBindVertexArray(skyboxVAO);
-	cubemapTexture.use();
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	// What each texture unit and program is known to hold; null/false until
+	// set during this frame.
+	const GLTexture* boundTextures[2] = {};
+	GLenum activeUnit = GL_TEXTURE0;
 
-	//glDepthFunc(GL_LESS); // set depth function back to default
-	glDepthMask(GL_TRUE);
+	DrawMaterial materials[static_cast<size_t>(SceneProgram::Count)];
+	bool materialValid[static_cast<size_t>(SceneProgram::Count)] = {};
 
-	defaultShader.use();
+	auto bindTexture = [&](GLenum unit, const GLTexture* texture)
+	{
+		auto& bound = boundTextures[unit - GL_TEXTURE0];
+		if (!texture || bound == texture)
+			return;
 
-	drawTree({ -20.0f, 0.0f, -10.0f }, { 2.0f, 2.0f, 2.0f });
+		if (activeUnit != unit)
+		{
+			glActiveTexture(unit);
+			activeUnit = unit;
+		}
 
-	drawTree({ 20.0f, 0.0f, -10.0f }, { 2.0f, 2.0f, 2.0f });
+		texture->use();
+		bound = texture;
+		++renderStats.textureBinds;
+	};
 
-	drawTree({ -20.0f, 0.0f, 10.0f }, { 2.0f, 2.0f, 2.0f });
+	auto const& entries = renderQueue.entries();
 
-	drawTree({ 20.0f, 0.0f, 10.0f }, { 2.0f, 2.0f, 2.0f });
+	// Indirect draws are added in queue order, so each run of them that
+	// shares a material is a contiguous range of commands.
+	indirectDraws.clear();
 
-	drawTable({ 0.0f, 2.5f, 15.0f }, { 1.0f, 1.0f, 1.0f });
+	for (auto const& entry : entries)
+	{
+		auto const& item = drawItems[entry.item];
+		if (item.program != SceneProgram::Indirect)
+			continue;
 
-	auto model = glm::scale(glm::mat4(1.0f), glm::vec3(4.0f, 4.0f, 4.0f));
+		auto const& objModel = *item.mesh;
+		auto const lod = objModel.selectLod(item.transform, camera.Position, projection, static_cast<float>(windowHeight), lodPixelError);
 
-	model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		IndirectDrawData data;
+		data.model = item.transform * objModel.decodeMatrix();
+		data.normalMatrix = glm::transpose(glm::inverse(data.model));
+		data.color = glm::vec4(item.material.color, 1.0f);
 
-	defaultShader.setMat4("model", model);
-	houseTexture.use();
+		indirectDraws.add(objModel.mesh, lod, data);
+	}
 
-	house.draw();
+	indirectDraws.upload();
 
-	groundTexture.use();
+	uint32_t nextIndirectDraw = 0;
 
-	ground.draw();
-}
+	// Between the opaque and transparent passes; blended draws make poor
+	// occluders. Changes state behind the tracking's back, so it is reset.
+	bool disoccludedDrawn = false;
 
-void OpenGLRenderer::drawScene()
-{
-	glClearColor(0.4f, 0.6f, 0.9f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// Name of the open profiler scope, if any.
+	const char* profiled = nullptr;
+
+	auto drawDisoccluded = [&]()
+	{
+		if (profiled)
+		{
+			OGL_PROFILE_END();
+			profiled = nullptr;
+		}
+
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+
+		drawDisoccludedInstances();
+
+		disoccludedDrawn = true;
+
+		currentProgram = SceneProgram::Count;
+		boundTextures[0] = boundTextures[1] = nullptr;
+		activeUnit = GL_TEXTURE0;
+		materialValid[static_cast<size_t>(SceneProgram::Instanced)] = false;
+		materialValid[static_cast<size_t>(SceneProgram::InstancedAlphaTest)] = false;
+	};
 
 	glActiveTexture(GL_TEXTURE0);
 
-	drawModel();
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		auto const& entry = entries[i];
+		auto const& item = drawItems[entry.item];
 
-	drawDog();
+		auto const pass = RenderQueue::pass(entry.key);
+		if (pass != currentPass)
+		{
+			if (pass == RenderPass::Transparent && !disoccludedDrawn)
+				drawDisoccluded();
 
-	drawDragon();
+			glDepthMask(pass == RenderPass::Background ? GL_FALSE : GL_TRUE);
 
-	drawMovingLight();
+			if (pass == RenderPass::Transparent)
+				glEnable(GL_BLEND);
+			else
+				glDisable(GL_BLEND);
 
-	drawCrate();
+			currentPass = pass;
+		}
 
-	wooden.Draw(shader);
+		// A multi-draw batch counts towards the part of its first draw.
+		if (item.profileName != profiled)
+		{
+			if (profiled)
+				OGL_PROFILE_END();
 
-	glEnable(GL_BLEND);
+			if (item.profileName)
+				OGL_PROFILE_BEGIN(item.profileName);
 
-	auto model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 5.0f));
-	model = glm::scale(model, glm::vec3(0.01f));
+			profiled = item.profileName;
+		}
 
-	shader.setMat4("model", model);
+		if (item.program != currentProgram)
+		{
+			useProgram(item.program);
+			currentProgram = item.program;
+			++renderStats.programChanges;
+		}
 
-	plants.Draw(shader);
+		auto const programIndex = static_cast<size_t>(item.program);
 
-	glDisable(GL_BLEND);
+		switch (item.kind)
+		{
+		case DrawItem::Kind::Skybox:
+			{
+				bindTexture(GL_TEXTURE0, item.material.albedo);
+
+				// remove translation from the view matrix
+				auto view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
+				skyboxShader.setMat4("view", view);
+
+				glBindVertexArray(skyboxVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 36);
+			}
+			break;
+
+		case DrawItem::Kind::Mesh:
+			if (item.program == SceneProgram::Indirect)
+			{
+				bindTexture(GL_TEXTURE0, item.material.albedo);
+				bindTexture(GL_TEXTURE1, item.material.specular);
+
+				// The color is per draw; the rest of the material is shared
+				// by the batch.
+				auto material = item.material;
+				material.color = glm::vec3(1.0f);
+
+				renderStats.uniformUpdates += setMaterial(indirectShader, material, materialValid[programIndex] ? &materials[programIndex] : nullptr);
+
+				materials[programIndex] = material;
+				materialValid[programIndex] = true;
+
+				// While profiling, batches also end where the profiled part
+				// changes, so that each part is timed on its own.
+				bool const splitParts = GpuProfiler::instance().enabled();
+
+				auto sameBatch = [&](const RenderQueue::Entry& other) {
+					auto const& next = drawItems[other.item];
+					return next.program == SceneProgram::Indirect && RenderQueue::pass(other.key) == pass
+						&& next.material.albedo == item.material.albedo && next.material.specular == item.material.specular
+						&& next.material.enableSpecular == item.material.enableSpecular
+						&& (!splitParts || next.profileName == item.profileName);
+				};
+
+				uint32_t count = 1;
+				while (i + count < entries.size() && sameBatch(entries[i + count]))
+					++count;
+
+				indirectDraws.draw(nextIndirectDraw, count);
+
+				nextIndirectDraw += count;
+				renderStats.indirectDraws += count;
+
+				i += count - 1;
+				break;
+			}
+			// fall through
+		case DrawItem::Kind::Instanced:
+			{
+				bindTexture(GL_TEXTURE0, item.material.albedo);
+				bindTexture(GL_TEXTURE1, item.material.specular);
+
+				auto const& program = item.program == SceneProgram::Instanced ? instancedShader
+					: item.program == SceneProgram::InstancedAlphaTest ? instancedAlphaTestShader
+					: defaultShader;
+				renderStats.uniformUpdates += setMaterial(program, item.material, materialValid[programIndex] ? &materials[programIndex] : nullptr);
+
+				materials[programIndex] = item.material;
+				materialValid[programIndex] = true;
+
+				if (item.kind == DrawItem::Kind::Instanced)
+					item.mesh->drawInstanced(item.lod);
+				else
+					drawMesh(*item.mesh, item.transform);
+			}
+			break;
+
+		case DrawItem::Kind::Model:
+			{
+				renderStats.uniformUpdates += setMaterial(shader, item.material, materialValid[programIndex] ? &materials[programIndex] : nullptr);
+
+				materials[programIndex] = item.material;
+				materialValid[programIndex] = true;
+
+				setModelMatrix(shader, shaderBlocks.object, objectUniformRing, item.transform);
+
+				item.model->Draw(shader);
+
+				// Model::Draw() binds its own textures (and leaves unit 0 active).
+				boundTextures[0] = boundTextures[1] = nullptr;
+				activeUnit = GL_TEXTURE0;
+			}
+			break;
+		}
 
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 10.0f, 10.0f));
-	model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-	model = glm::scale(model, glm::vec3(5.0f, 5.0f, 5.0f));
+		++renderStats.drawCalls;
+	}
+
+	if (!disoccludedDrawn)
+		drawDisoccluded();
+
+	if (profiled)
+		OGL_PROFILE_END();
 
-	shader.setMat4("model", model);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
 
-	signature.Draw(shader);
+	glActiveTexture(GL_TEXTURE0);
 }
 
-void OpenGLRenderer::updateConstantMovement()
+void OpenGLRenderer::drawScene()
 {
-	if (tailWiggleAngle > 8 || tailWiggleAngle < -8)
+	// Its parts are profiler scopes, which are traced as well.
+	OGL_TRACE_SCOPE("drawScene");
+
+	glClearColor(0.4f, 0.6f, 0.9f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	renderQueue.clear();
+	drawItems.clear();
+
+	renderStats = {};
+
+	// The oldest query is from kPrimitiveQueryCount frames ago; if it is still
+	// not done, the previous count is shown again.
+	if (!primitiveQueries[0])
+		glGenQueries(kPrimitiveQueryCount, primitiveQueries);
+
+	GLuint primitiveQuery = primitiveQueries[primitiveQueryIndex];
+	primitiveQueryIndex = (primitiveQueryIndex + 1) % kPrimitiveQueryCount;
+
+	if (glIsQuery(primitiveQuery))
 	{
-		tailWiggleDirectionLeft = !tailWiggleDirectionLeft;
+		GLint available = 0;
+		glGetQueryObjectiv(primitiveQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available)
+		{
+			GLuint64 primitives = 0;
+			glGetQueryObjectui64v(primitiveQuery, GL_QUERY_RESULT, &primitives);
+			lastTriangles = primitives;
+		}
 	}
-	if (tailWiggleDirectionLeft)
+
+	renderStats.triangles = lastTriangles;
+
+	glBeginQuery(GL_PRIMITIVES_GENERATED, primitiveQuery);
+
 	{
-		tailWiggleAngle += 1.7f;
-	}
-	else {
-		tailWiggleAngle -= 1.7f;
+		OGL_PROFILE_SCOPE("submit");
+
+		submitStaticScene();
+
+		submitDog();
+
+		submitDragon();
+
+		submitMovingLight();
+
+		submitCrates();
+
+		queueVisibleItems();
+
+		renderQueue.sort();
 	}
-	if (isMoving) {
-		if (legsAngle > 20 || legsAngle < -20)
-		{
-			legsMovementDirectionForward = !legsMovementDirectionForward;
-		}
-		if (legsMovementDirectionForward)
-		{
-			legsAngle += 6.0;
-		}
-		else {
-			legsAngle -= 6.0;
-		}
-		isMoving = false;
+
+	{
+		OGL_PROFILE_SCOPE("gpu culling");
+
+		cullInstances();
 	}
+
+	executeRenderQueue();
+
+	glEndQuery(GL_PRIMITIVES_GENERATED);
 }
 
 void OpenGLRenderer::updateUniforms()
 {
-	defaultShader.use();
-
-	auto model = glm::mat4(1.0f);
 	auto view = camera.GetViewMatrix();
 	projection = glm::perspective(glm::radians(45.0f), static_cast<float>(windowWidth) / windowHeight, 0.1f, 500.0f);
 
-	defaultShader.setMat4("model", model);
-	defaultShader.setMat4("view", view);
-	defaultShader.setMat4("projection", projection);
-
-	defaultShader.setVec3("lightPosition", lightPosition);
-	defaultShader.setVec3("movingLightPosition", movingLightPosition);
-	defaultShader.setVec3("ambientColor", ambientColor);
-	defaultShader.setVec3("lightColor", lightColor);
-	defaultShader.setVec3("movingLightColor", movingLightColor);
-	defaultShader.setVec3("directionalLightColor", directionalLightColor);
-	defaultShader.setVec3("viewPosition", camera.Position);
-	defaultShader.setFloat("shininess", shininess);
-	defaultShader.setBool("enableToonShading", enableToonShading);
+	// Written once, shared by every program through kFrameUniformBinding.
+	FrameUniforms frame = {};
+	frustum = camera.GetFrustum(projection);
+
+	frame.view = view;
+	frame.projection = projection;
+	frame.viewProjection = projection * view;
+	frame.viewPosition = glm::vec4(camera.Position, 1.0f);
+	frame.lightPosition = glm::vec4(lightPosition, 1.0f);
+	frame.movingLightPosition = glm::vec4(renderedAnimation.movingLightPosition, 1.0f);
+	frame.ambientColor = glm::vec4(ambientColor, 1.0f);
+	frame.lightColor = glm::vec4(lightColor, 1.0f);
+	frame.movingLightColor = glm::vec4(movingLightColor, 1.0f);
+	frame.directionalLightColor = glm::vec4(directionalLightColor, 1.0f);
+	frame.shininess = shininess;
+	frame.enableToonShading = enableToonShading ? 1 : 0;
+
+	frameStream.beginFrame();
+	frameUniformRing.push(frame);
+
+	// Programs that do not declare the block still get loose uniforms.
+	if (!defaultShaderBlocks.frame)
+	{
+		defaultShader.use();
+		setFrameUniforms(defaultShader, frame);
+	}
 
-	skyboxShader.use();
+	if (!skyboxShaderBlocks.frame)
+	{
+		skyboxShader.use();
 
-	skyboxShader.setMat4("view", view);
-	skyboxShader.setMat4("projection", projection);
+		skyboxShader.setMat4("view", view);
+		skyboxShader.setMat4("projection", projection);
+	}
 
 	shader.use();
 
-	shader.setMat4("model", model);
-	shader.setMat4("view", view);
-	shader.setMat4("projection", projection);
-
-	shader.setVec3("lightPosition", lightPosition);
-	shader.setVec3("movingLightPosition", movingLightPosition);
-	shader.setVec3("ambientColor", ambientColor);
-	shader.setVec3("lightColor", lightColor);
-	shader.setVec3("movingLightColor", movingLightColor);
-	shader.setVec3("directionalLightColor", directionalLightColor);
-	shader.setVec3("viewPosition", camera.Position);
-	shader.setFloat("shininess", shininess);
-	shader.setBool("enableToonShading", enableToonShading);
+	if (!shaderBlocks.frame)
+	{
+		setFrameUniforms(shader, frame);
+	}
 }
 
 void OpenGLRenderer::update()
@@ -3,6 +3,8 @@
 #include <glad.h>
 #include <GLFW/glfw3.h>
 
+#include <random>
+#include <unordered_map>
 #include <typeinfo>
 #include <stdexcept>
 
@@ -13,12 +15,25 @@
 #include "../support/program.hpp"
 #include "../support/checkpoint.hpp"
 #include "../support/debug_output.hpp"
+#include "../support/trace.hpp"
 
 #include "defaults.hpp"
 
 #include "camera.hpp"
+#include "dog.hpp"
+#include "frame_pacer.hpp"
 #include "ObjModel.hpp"
-#include "texture.hpp"
+#include "gl_texture.hpp"
+#include "gpu_culling.hpp"
+#include "hiz_buffer.hpp"
+#include "job_system.hpp"
+#include "mesh_arena.hpp"
+#include "perf_hud.hpp"
+#include "render_queue.hpp"
+#include "simulation.hpp"
+#include "stream_buffer.hpp"
+#include "texture_streamer.hpp"
+#include "uniform_buffer.hpp"
 
 #include <learnopengl/model.h>
 
@@ -85,6 +100,46 @@ namespace
 	};
 }
 
+// Which of the shared uniform blocks a program declares.
+struct ProgramBlocks
+{
+	bool frame = false;
+	bool object = false;
+};
+
+// Per-draw uniforms and textures of the default and instanced programs.
+struct DrawMaterial
+{
+	// Bound to unit 0.
+	const GLTexture* albedo = nullptr;
+	// Bound to unit 1; also turns on useSpecularMap.
+	const GLTexture* specular = nullptr;
+	glm::vec3 color{ 1.0f };
+	bool enableSpecular = false;
+	// Discards texels with little alpha (cut-out foliage). Instanced draws
+	// only, and only where needed: such draws lose early depth testing.
+	bool alphaTest = false;
+};
+
+// How startUp() creates the window and its context.
+struct WindowOptions
+{
+	enum class ContextApi
+	{
+		// WGL/GLX, whatever GLFW uses by default.
+		Native,
+		EGL,
+		// Mesa's software renderer. With GLFW 3.4, no display server is
+		// needed at all.
+		OSMesa
+	};
+
+	// Hidden windows are for offscreen rendering (see Benchmark); the
+	// performance overlay is not created for them.
+	bool visible = true;
+	ContextApi contextApi = ContextApi::Native;
+};
+
 class OpenGLRenderer
 {
 public:
@@ -92,28 +147,38 @@ public:
 
 	~OpenGLRenderer() {}
 
-	void startUp();
+	void startUp(const WindowOptions& options = {});
 
 	void loadShaders();
-	void loadModels();
-	void loadTextures();
+	void loadModels(JobSystem& jobs);
+	void loadTextures(JobSystem& jobs);
 	void loadGeometry();
+	// Uploads every loaded ObjModel into meshArena.
+	void createMeshArena();
 	void loadResources();
 
+	void updateTextureStreaming();
+
 	void updateInput(float deltaTime);
-	void updateTreeRotation();
-	void drawDog();
-	void drawDragon();
-	void drawMovingLight();
-	void drawCrate();
-	void drawTree(const glm::vec3& translation, const glm::vec3& scale);
-	void drawTable(const glm::vec3& translation, const glm::vec3& scale);
+	// Runs the fixed-timestep simulation steps that fit into the frame time
+	// and interpolates the animation that the frame draws.
+	void updateSimulation(float frameTime);
+	// Add the scene's draws to the render queue; nothing is drawn until
+	// drawScene() executes the sorted queue.
+	void submitDog();
+	void submitDragon();
+	void submitMovingLight();
+	void submitCrates();
+	void submitTrees();
+	void submitTable(const glm::vec3& translation, const glm::vec3& scale);
+	void submitStaticScene();
 	void drawModel(const ObjModel& objModel, const glm::vec3& translation, const glm::vec3& scale);
-	void drawModel();
+	// Sets "model" (including the mesh's position decode) and draws the LOD
+	// that fits the current view.
+	void drawMesh(const ObjModel& objModel, const glm::mat4& model);
+	// Queues the whole scene, sorts it by render state and draws it.
 	void drawScene();
 
-	void updateConstantMovement();
-
 	void updateUniforms();
 
 	void update();
@@ -126,6 +191,19 @@ public:
 
 	ObjModel createSphere(float radius, uint32_t sliceCount, uint32_t stackCount);
 
+	// Placements of the instanced props. Each kind is drawn with one
+	// instanced draw per mesh, however many placements it has.
+	void addTreeInstance(const glm::vec3& translation, const glm::vec3& scale);
+	void addCrateInstance(const glm::vec3& translation, const glm::vec3& scale = glm::vec3(1.0f));
+
+	// Adds randomly placed trees and crates within [-radius, radius] on XZ.
+	void scatterProps(size_t treeCount, size_t crateCount, float radius, uint32_t seed = 1);
+
+	// Extra dogs, animated in sync with the main one and drawn in the same
+	// instanced draw (one instance per part).
+	void addDog(const glm::vec3& position, float yaw);
+	void scatterDogs(size_t count, float radius, uint32_t seed = 1);
+
 	GLFWwindow* getWindow() const { return window; }
 
 	int getWindowWidth() const { return windowWidth; }
@@ -151,10 +229,131 @@ public:
 
 	float shininess = 128.0f;
 
+	// Screen-space error (in pixels) up to which coarser mesh LODs are used.
+	// 0 always draws full detail.
+	float lodPixelError = 1.0f;
+
+	// Load 2D textures through the cooked BC1/BC3 cache (when supported).
+	bool useCompressedTextures = true;
+
+	// Draw the default-program meshes with one glMultiDrawElementsIndirect
+	// per material instead of one draw each.
+	bool useMultiDrawIndirect = true;
+
+	// Frustum cull the instanced props on the GPU (see gpu_culling.hpp).
+	bool useGpuCulling = true;
+
+	// Also drop GPU-culled instances hidden behind the previous frame's
+	// depth, re-testing them against this frame's (see InstanceCuller).
+	bool useOcclusionCulling = true;
+
+	// Frustum cull individual draws on the CPU before they are queued (and
+	// instance placements too, while GPU culling is off). Objects whose
+	// bounding sphere projects to less than minScreenRadius pixels are
+	// dropped as well.
+	bool useCpuCulling = true;
+	float minScreenRadius = 0.5f;
+
+	// Presentation mode and frames in flight; the main loop brackets each
+	// frame with its beginFrame() and endFrame().
+	FramePacer framePacer;
+
+	// Draw and state change counts of the last drawScene().
+	RenderQueueStats renderStats;
+
+	// Performance overlay, drawn by the main loop after the scene while
+	// bShowImGUIWindow is set (F1 toggles it).
+	PerfHud perfHud;
+	bool bShowImGUIWindow = true;
+
 private:
+	friend class PerfHud;
+
+	// Programs the scene is drawn with. Part of the sort key, so draws are
+	// grouped by program in this order within a pass.
+	enum class SceneProgram : uint8_t
+	{
+		Skybox,
+		Default,
+		Instanced,
+		InstancedAlphaTest,
+		Indirect,
+		Model,
+		Count
+	};
+
+	// A queued draw; RenderQueue entries index into drawItems.
+	struct DrawItem
+	{
+		enum class Kind : uint8_t
+		{
+			Skybox,
+			Mesh,
+			Instanced,
+			Model
+		};
+
+		Kind kind;
+		SceneProgram program;
+		const ObjModel* mesh = nullptr;
+		Model* model = nullptr;
+		DrawMaterial material;
+		glm::mat4 transform{ 1.0f };
+
+		RenderPass pass = RenderPass::Opaque;
+		float depth = 0.0f;
+
+		// World space bounding sphere; never culled if the radius is
+		// negative.
+		glm::vec4 bounds{ 0.0f, 0.0f, 0.0f, -1.0f };
+
+		// LOD of an instanced batch, for every placement; picked on
+		// submission, since the GPU culling pass needs it before the draw.
+		size_t lod = 0;
+
+		// Profiler scope the draw is timed under; see submitProfileName.
+		const char* profileName = nullptr;
+	};
+
+	void submit(DrawItem item, RenderPass pass, float depth);
+	void submitSkybox();
+	void submitMesh(const ObjModel& objModel, const glm::mat4& model, const DrawMaterial& material);
+	void submitInstanced(ObjModel& objModel, const DrawMaterial& material);
+	void submitModel(Model& model, const glm::mat4& transform, RenderPass pass);
+
+	// Frustum and screen size tests for the submitted draws; only the
+	// visible ones are added to the render queue.
+	void queueVisibleItems();
+
+	// Removes the placements of objModel that CPU culling rejects (see
+	// useCpuCulling), along with their colors if given.
+	void cullPlacements(const ObjModel& objModel, std::vector<glm::mat4>& transforms, std::vector<glm::vec4>* colors = nullptr);
+
+	ScreenSizeCull screenSizeCull() const;
+
+	// Runs the GPU culling pass for the queued instanced draws.
+	void cullInstances();
+
+	// Called once the opaque draws are done: rebuilds the Hi-Z buffer from
+	// their depth, then re-tests and draws the instances that the previous
+	// frame's depth wrongly hid.
+	void drawDisoccludedInstances();
+
+	// Draws the sorted queue, skipping program, texture and material changes
+	// that would not change anything.
+	void executeRenderQueue();
+
+	void useProgram(SceneProgram program);
+
 	ShaderProgram defaultShader;
 	ShaderProgram quadShader;
 	ShaderProgram skyboxShader;
+	ShaderProgram instancedShader;
+	ShaderProgram instancedAlphaTestShader;
+	ShaderProgram indirectShader;
+
+	InstanceCuller instanceCuller;
+	HiZBuffer hiZBuffer;
 
 	ObjModel house;
 	ObjModel ground;
@@ -171,6 +370,11 @@ private:
 
 	ObjModel dog;
 
+	// Shared buffers of all the ObjModels above, and the per-frame indirect
+	// draws into them.
+	MeshArena meshArena;
+	IndirectDrawList indirectDraws;
+
 	Model wooden;
 
 	Model plants;
@@ -179,20 +383,87 @@ private:
 
 	Shader shader;
 
-	ModelTexture houseTexture;
-	ModelTexture cubemapTexture;
-	ModelTexture groundTexture;
-	ModelTexture treeTexture;
-	ModelTexture trunkTexture;
-	ModelTexture defaultTexture;
-	ModelTexture tableTexture;
-	ModelTexture crateDiffuseTexture;
-	ModelTexture crateSpecularTexture;
-	ModelTexture signatureTexture;
+	// Everything written per frame: uniform blocks, indirect draw lists and
+	// the placements that are rebuilt every frame.
+	StreamBuffer frameStream;
 
-	glm::vec3 lightPosition{ -20.0f, 20.0f, 20.0f };
+	// FrameUniforms, pushed once per frame, and ObjectUniforms, once per draw
+	// (see uniform_buffer.hpp).
+	UniformRing frameUniformRing;
+	UniformRing objectUniformRing;
+
+	ProgramBlocks defaultShaderBlocks;
+	ProgramBlocks skyboxShaderBlocks;
+	ProgramBlocks shaderBlocks;
 
-	glm::vec3 movingLightPosition{ 3.0f, 5.0f, 15.0f };
+	struct PropInstance
+	{
+		glm::vec3 translation;
+		glm::vec3 scale;
+	};
+
+	std::vector<PropInstance> treeInstances = {
+		{ { -20.0f, 0.0f, -10.0f }, { 2.0f, 2.0f, 2.0f } },
+		{ { 20.0f, 0.0f, -10.0f }, { 2.0f, 2.0f, 2.0f } },
+		{ { -20.0f, 0.0f, 10.0f }, { 2.0f, 2.0f, 2.0f } },
+		{ { 20.0f, 0.0f, 10.0f }, { 2.0f, 2.0f, 2.0f } },
+	};
+
+	std::vector<PropInstance> crateInstances = {
+		{ { -5.0f, 1.0f, 20.0f }, { 1.0f, 1.0f, 1.0f } },
+	};
+
+	bool crateInstancesDirty = true;
+
+	RenderQueue renderQueue;
+	std::vector<DrawItem> drawItems;
+
+	// Part of the scene that submit() attributes draws to, set by the
+	// submit* functions. executeRenderQueue() times each run of draws of one
+	// part as a profiler scope of that name (GpuProfiler sums the runs).
+	const char* submitProfileName = nullptr;
+
+	// World space frustum of the current frame, from updateUniforms().
+	Frustum frustum;
+
+	// GL_PRIMITIVES_GENERATED around each drawScene(), read a few frames
+	// later so the count never stalls (see RenderQueueStats::triangles).
+	static constexpr unsigned kPrimitiveQueryCount = 4;
+	GLuint primitiveQueries[kPrimitiveQueryCount] = {};
+	unsigned primitiveQueryIndex = 0;
+	uint64_t lastTriangles = 0;
+
+	// Scratch space for culling.
+	SphereBatch cullSpheresBatch;
+	std::vector<uint8_t> cullVisibility;
+	std::vector<glm::mat4> visibleTransforms;
+
+	// Model space bounding spheres of the learnopengl models, computed on
+	// first use.
+	std::unordered_map<const Model*, glm::vec4> modelBounds;
+
+	// Root transforms of the dogs besides the main one.
+	std::vector<glm::mat4> herd;
+
+	// Scratch space for building instance data.
+	std::vector<glm::mat4> instanceTransforms;
+	std::vector<glm::vec4> instanceColors;
+
+	GLTexture houseTexture;
+	GLTexture cubemapTexture;
+	GLTexture groundTexture;
+	GLTexture treeTexture;
+	GLTexture trunkTexture;
+	GLTexture defaultTexture;
+	GLTexture tableTexture;
+	GLTexture crateDiffuseTexture;
+	GLTexture crateSpecularTexture;
+	GLTexture signatureTexture;
+
+	// Spreads texture uploads over several frames (8 MiB per frame).
+	TextureStreamer textureStreamer;
+
+	glm::vec3 lightPosition{ -20.0f, 20.0f, 20.0f };
 
 	glm::vec3 movingLightColor{ 1.0f, 0.0f, 0.0f };
 
@@ -200,10 +471,7 @@ private:
 	glm::vec3 lightColor{ 1.0f, 1.0f, 1.0f };
 	glm::vec3 directionalLightColor{ 1.0f, 1.0f, 1.0f };
 
-	float dogOffset = 20.0f;
-
 	bool bShowDemoWindow = false;
-	bool bShowImGUIWindow = true;
 	bool bShowAnotherWindow = false;
 
 	bool enableToonShading = false;
@@ -212,19 +480,18 @@ private:
 	float headVerticalAngle = 10.0f;
 	float tailHorizontalAngle = 0.0f;
 	float tailVerticalAngle = -10.0f;
-	float tailWiggleAngle = 0.0f;
-	bool tailWiggleDirectionLeft = true;
-	float legsAngle = 0.0f;
-	bool legsMovementDirectionForward = true;
-	bool isMoving = false;
 
 	GLFWwindow* window = nullptr;
 
 	float frameTime = 0.0f;
 
-	float treeRotation = 0.0f;
-
-	float treeRotationDirection = 1.0f;
+	// Stepped at a fixed rate by updateSimulation(). The draws read
+	// renderedAnimation, blended between the last two steps.
+	FixedTimestep simulationClock;
+	SceneInput sceneInput;
+	SceneAnimation previousAnimation;
+	SceneAnimation animation;
+	SceneAnimation renderedAnimation;
 
 	// skybox VAO
 	unsigned int skyboxVAO, skyboxVBO;
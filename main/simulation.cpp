@@ -0,0 +1,100 @@
+#include "simulation.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+
+namespace
+{
+	// Per reference frame, as the original per-frame updates had them.
+	constexpr float kTreeRotationSpeed = 0.1f;
+	constexpr float kTailWiggleSpeed = 1.7f;
+	constexpr float kLegsSpeed = 6.0f;
+	constexpr float kDogSpeed = 0.02f;
+
+	// Center of the moving light's orbit, in the XZ plane.
+	constexpr float kLightOrbitX = 0.0f;
+	constexpr float kLightOrbitZ = 20.0f;
+}
+
+FixedTimestep::FixedTimestep(float stepSize, unsigned maxStepsPerFrame)
+	: mStepSize(stepSize)
+	, mMaxBacklog(stepSize * std::max(1u, maxStepsPerFrame))
+{}
+
+void FixedTimestep::advance(float frameTime)
+{
+	// After a hitch (loading, a breakpoint, dragging the window) drop what
+	// does not fit rather than catch up in a burst of steps that makes the
+	// next frame slower still.
+	mAccumulator = std::min(mAccumulator + std::max(frameTime, 0.0f), mMaxBacklog);
+}
+
+bool FixedTimestep::step()
+{
+	if (mAccumulator < mStepSize)
+		return false;
+
+	mAccumulator -= mStepSize;
+	++mSteps;
+
+	return true;
+}
+
+void stepAnimation(SceneAnimation& animation, const SceneInput& input, float deltaTime)
+{
+	auto const frames = deltaTime * kAnimationReferenceRate;
+
+	animation.treeRotation += kTreeRotationSpeed * frames * animation.treeRotationDirection;
+
+	if (animation.treeRotation > 5.0f || animation.treeRotation < -5.0f)
+	{
+		animation.treeRotationDirection = -animation.treeRotationDirection;
+	}
+
+	if (animation.tailWiggleAngle > 8.0f || animation.tailWiggleAngle < -8.0f)
+	{
+		animation.tailWiggleDirectionLeft = !animation.tailWiggleDirectionLeft;
+	}
+
+	animation.tailWiggleAngle += (animation.tailWiggleDirectionLeft ? kTailWiggleSpeed : -kTailWiggleSpeed) * frames;
+
+	// The legs only swing while the dog walks.
+	if (input.dogDirection != 0.0f)
+	{
+		animation.dogOffset += kDogSpeed * frames * input.dogDirection;
+
+		if (animation.legsAngle > 20.0f || animation.legsAngle < -20.0f)
+		{
+			animation.legsMovementDirectionForward = !animation.legsMovementDirectionForward;
+		}
+
+		animation.legsAngle += (animation.legsMovementDirectionForward ? kLegsSpeed : -kLegsSpeed) * frames;
+	}
+
+	if (input.movingLightRotation != 0.0f)
+	{
+		auto const a = glm::radians(input.movingLightRotation * frames);
+
+		auto const x = animation.movingLightPosition.x - kLightOrbitX;
+		auto const z = animation.movingLightPosition.z - kLightOrbitZ;
+
+		animation.movingLightPosition.x = x * std::cos(a) - z * std::sin(a) + kLightOrbitX;
+		animation.movingLightPosition.z = x * std::sin(a) + z * std::cos(a) + kLightOrbitZ;
+	}
+}
+
+SceneAnimation interpolate(const SceneAnimation& previous, const SceneAnimation& current, float alpha)
+{
+	auto blend = [alpha](float a, float b) { return a + (b - a) * alpha; };
+
+	SceneAnimation result = current;
+
+	result.treeRotation = blend(previous.treeRotation, current.treeRotation);
+	result.tailWiggleAngle = blend(previous.tailWiggleAngle, current.tailWiggleAngle);
+	result.legsAngle = blend(previous.legsAngle, current.legsAngle);
+	result.dogOffset = blend(previous.dogOffset, current.dogOffset);
+	result.movingLightPosition = glm::mix(previous.movingLightPosition, current.movingLightPosition, alpha);
+
+	return result;
+}
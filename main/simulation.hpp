@@ -0,0 +1,73 @@
+#pragma once
+
+#include "glm.hpp"
+
+// Splits the variable frame time into fixed simulation steps, so animation
+// runs at the same speed whatever the frame rate or presentation mode:
+//
+//	clock.advance(frameTime);
+//	while (clock.step())
+//		... advance the simulation by clock.stepSize() ...
+//	... render, blending the last two steps by clock.alpha() ...
+class FixedTimestep
+{
+public:
+	explicit FixedTimestep(float stepSize = 1.0f / 120.0f, unsigned maxStepsPerFrame = 8);
+
+	// Adds the duration of the last frame, in seconds.
+	void advance(float frameTime);
+
+	// Consumes one step if a whole one has accumulated.
+	bool step();
+
+	float stepSize() const { return mStepSize; }
+
+	// How far past the last step the clock is, in [0, 1): the weight of the
+	// latest step when interpolating for rendering.
+	float alpha() const { return mAccumulator / mStepSize; }
+
+	unsigned long long steps() const { return mSteps; }
+
+private:
+	float mStepSize;
+	float mMaxBacklog;
+	float mAccumulator = 0.0f;
+	unsigned long long mSteps = 0;
+};
+
+// Everything in the scene that moves on its own.
+struct SceneAnimation
+{
+	float treeRotation = 0.0f;
+	float treeRotationDirection = 1.0f;
+
+	float tailWiggleAngle = 0.0f;
+	bool tailWiggleDirectionLeft = true;
+
+	float legsAngle = 0.0f;
+	bool legsMovementDirectionForward = true;
+
+	float dogOffset = 20.0f;
+
+	glm::vec3 movingLightPosition{ 3.0f, 5.0f, 15.0f };
+};
+
+// Input sampled once per frame and held for all of the frame's steps.
+struct SceneInput
+{
+	// +1 walks the dog forward, -1 backward, 0 lets it stand still.
+	float dogDirection = 0.0f;
+
+	// Orbit speed of the moving light in degrees per reference frame (see
+	// kAnimationReferenceRate); 0 stops it.
+	float movingLightRotation = 0.0f;
+};
+
+// The animation speeds are given per frame at this rate, the V-Sync rate
+// they were originally tuned at.
+constexpr float kAnimationReferenceRate = 60.0f;
+
+void stepAnimation(SceneAnimation& animation, const SceneInput& input, float deltaTime);
+
+// Blends continuous values; discrete ones (directions) come from current.
+SceneAnimation interpolate(const SceneAnimation& previous, const SceneAnimation& current, float alpha);
@@ -0,0 +1,192 @@
+#include "stream_buffer.hpp"
+
+#include <algorithm>
+
+#include <cstring>
+
+#include "texture_streamer.hpp"
+
+namespace
+{
+	size_t alignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Every target the stream is used for binds its ranges at multiples of
+	// this.
+	constexpr size_t kRegionAlignment = 256;
+
+	size_t queryAlignment(GLenum name)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(name, &alignment);
+		return size_t(alignment);
+	}
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for (auto fence : mFences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+	}
+
+	for (auto& retired : mRetired)
+	{
+		if (retired.fence)
+			glDeleteSync(retired.fence);
+
+		glDeleteBuffers(1, &retired.buffer);
+	}
+
+	// Deleting a mapped buffer unmaps it.
+	if (0 != mBuffer)
+		glDeleteBuffers(1, &mBuffer);
+}
+
+void StreamBuffer::create(size_t bytesPerFrame, unsigned frameCount)
+{
+	mFences.assign(std::max(1u, frameCount), nullptr);
+
+	allocate(bytesPerFrame);
+}
+
+void StreamBuffer::allocate(size_t bytesPerFrame)
+{
+	mBytesPerFrame = alignUp(std::max<size_t>(bytesPerFrame, 1), kRegionAlignment);
+	mRegion = 0;
+	mHead = 0;
+
+	auto const size = GLsizeiptr(mBytesPerFrame * mFences.size());
+
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+	mMapped = nullptr;
+
+#	if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+	if (bufferStorageSupported())
+	{
+		GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		mMapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+	}
+	else
+#	endif
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::grow(size_t required)
+{
+	// Draws of this frame may already reference the old buffer, so it lives
+	// on until the fence that beginFrame() gives it.
+	mRetired.push_back(Retired{ mBuffer, nullptr });
+
+	// The retired buffer's fence covers every older frame as well.
+	for (auto& fence : mFences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+
+		fence = nullptr;
+	}
+
+	auto bytesPerFrame = mBytesPerFrame * 2;
+	while (bytesPerFrame < required)
+		bytesPerFrame *= 2;
+
+	allocate(bytesPerFrame);
+}
+
+void StreamBuffer::beginFrame()
+{
+	if (0 == mBuffer)
+		return;
+
+	mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	for (auto& retired : mRetired)
+	{
+		if (!retired.fence)
+			retired.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(), [](Retired const& retired) {
+		if (GL_TIMEOUT_EXPIRED == glClientWaitSync(retired.fence, 0, 0))
+			return false;
+
+		glDeleteSync(retired.fence);
+		glDeleteBuffers(1, &retired.buffer);
+		return true;
+	}), mRetired.end());
+
+	mRegion = (mRegion + 1) % static_cast<unsigned>(mFences.size());
+	mHead = 0;
+
+	auto& fence = mFences[mRegion];
+	if (fence)
+	{
+		// Only happens when the GPU is frameCount - 1 frames behind; then
+		// there is nothing better to do than to wait for it.
+		if (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, 0, 0))
+		{
+			++mStalls;
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+		}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+StreamBuffer::Range StreamBuffer::write(const void* data, size_t size, size_t alignment)
+{
+	auto offset = alignUp(mHead, alignment);
+
+	if (offset + size > mBytesPerFrame)
+	{
+		grow(size);
+		offset = 0;
+	}
+
+	mHead = offset + size;
+
+	Range range;
+	range.buffer = mBuffer;
+	range.offset = GLintptr(mRegion * mBytesPerFrame + offset);
+
+	if (size == 0)
+		return range;
+
+	if (mMapped)
+	{
+		std::memcpy(mMapped + range.offset, data, size);
+	}
+	else
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset, GLsizeiptr(size), data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	return range;
+}
+
+size_t StreamBuffer::uniformAlignment()
+{
+	// There is only ever the one context.
+	static size_t const alignment = queryAlignment(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+	return alignment;
+}
+
+size_t StreamBuffer::storageAlignment()
+{
+	static size_t const alignment = queryAlignment(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT);
+	return alignment;
+}
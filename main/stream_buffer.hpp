@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstddef>
+
+// A buffer for data that is rewritten every frame: uniform blocks, indirect
+// draw commands, instance placements, streaming vertices.
+//
+// The buffer is split into frameCount equal regions. Each frame writes into
+// its own region, which beginFrame() protects with a fence once the frame is
+// done, so nothing is ever overwritten while the GPU may still read it and
+// nothing needs orphaning. When GL 4.4 / ARB_buffer_storage is available the
+// buffer is persistently and coherently mapped and write() is a plain
+// memcpy; otherwise it falls back to glBufferSubData.
+//
+// write() never blocks. beginFrame() only waits if the GPU falls more than
+// frameCount - 1 frames behind. A frame that outgrows its region continues in
+// a new buffer of twice the size; the old one is deleted once the GPU is done
+// with it.
+class StreamBuffer
+{
+public:
+	// Where write() put the data. The buffer changes when the stream grows,
+	// so bind what this says rather than caching buffer().
+	struct Range
+	{
+		GLuint buffer = 0;
+		GLintptr offset = 0;
+	};
+
+	StreamBuffer() = default;
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	void create(size_t bytesPerFrame, unsigned frameCount = 3);
+
+	// Fences the region written since the previous call and moves on to the
+	// next one. Call once per frame, before its first write().
+	void beginFrame();
+
+	// Copies size bytes to an offset that is a multiple of alignment (a power
+	// of two).
+	Range write(const void* data, size_t size, size_t alignment = 16);
+
+	GLuint buffer() const { return mBuffer; }
+	bool persistent() const { return mMapped != nullptr; }
+
+	size_t bytesPerFrame() const { return mBytesPerFrame; }
+	size_t bytes() const { return mBytesPerFrame * mFences.size(); }
+	// Bytes written since beginFrame(), including alignment padding.
+	size_t used() const { return mHead; }
+	// beginFrame() calls that had to wait for the GPU so far.
+	unsigned stalls() const { return mStalls; }
+
+	// Offset alignments that glBindBufferRange requires for the targets.
+	static size_t uniformAlignment();
+	static size_t storageAlignment();
+
+private:
+	struct Retired
+	{
+		GLuint buffer;
+		GLsync fence;
+	};
+
+	void allocate(size_t bytesPerFrame);
+	void grow(size_t required);
+
+	GLuint mBuffer = 0;
+	unsigned char* mMapped = nullptr;
+
+	size_t mBytesPerFrame = 0;
+	std::vector<GLsync> mFences;
+	unsigned mRegion = 0;
+	size_t mHead = 0;
+
+	std::vector<Retired> mRetired;
+	unsigned mStalls = 0;
+};
@@ -0,0 +1,332 @@
+#include "texture_cache.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <memory>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include "defaults.hpp"
+#include "gl_texture.hpp"
+#include "block_compression.hpp"
+
+// S3TC formats are an extension (EXT_texture_compression_s3tc) rather than
+// core GL, so the loader may not define them.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#	define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#	define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace
+{
+	// Bump to invalidate all cooked textures, e.g. after encoder changes.
+	constexpr uint32_t kCacheVersion = 1;
+
+	// Largest GL_MAX_TEXTURE_SIZE in practice. Caches are read on the loader
+	// workers, without a context to query the actual limit.
+	constexpr uint32_t kMaxCachedSize = 16384;
+
+	constexpr uint32_t fourCC(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+	}
+
+	constexpr uint32_t kDDSMagic = fourCC('D', 'D', 'S', ' ');
+	constexpr uint32_t kCacheTag = fourCC('T', 'C', 'C', 'H');
+
+	// DDS_HEADER and DDS_PIXELFORMAT as documented by Microsoft.
+	struct DDSPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask, gBitMask, bBitMask, aBitMask;
+	};
+
+	struct DDSHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32_t caps, caps2, caps3, caps4;
+		uint32_t reserved2;
+	};
+
+	static_assert(sizeof(DDSHeader) == 124, "DDS header must be 124 bytes");
+
+	constexpr uint32_t kDDSDCaps = 0x1, kDDSDHeight = 0x2, kDDSDWidth = 0x4, kDDSDPixelFormat = 0x1000;
+	constexpr uint32_t kDDSDMipMapCount = 0x20000, kDDSDLinearSize = 0x80000;
+	constexpr uint32_t kDDPFFourCC = 0x4;
+	constexpr uint32_t kDDSCapsComplex = 0x8, kDDSCapsTexture = 0x1000, kDDSCapsMipMap = 0x400000;
+
+	// Layout of reserved1[] used to key the cache.
+	enum CacheKey
+	{
+		kKeyTag, kKeyVersion, kKeySizeLo, kKeySizeHi, kKeyMtimeLo, kKeyMtimeHi, kKeyFlip
+	};
+
+	struct FileCloser
+	{
+		void operator()(std::FILE* file) const { std::fclose(file); }
+	};
+
+	using FilePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+	bool sourceStamp(const std::string& path, uint64_t& size, int64_t& mtime)
+	{
+		std::error_code ec;
+
+		size = std::filesystem::file_size(path, ec);
+		if (ec)
+			return false;
+
+		auto const time = std::filesystem::last_write_time(path, ec);
+		if (ec)
+			return false;
+
+		mtime = static_cast<int64_t>(time.time_since_epoch().count());
+		return true;
+	}
+
+	void computeLevels(int width, int height, bool hasAlpha, CompressedImage& image)
+	{
+		image.levels.clear();
+
+		size_t offset = 0;
+		for (;;)
+		{
+			auto const size = blockCompressedSize(width, height, hasAlpha);
+			image.levels.push_back({ width, height, offset, size });
+			offset += size;
+
+			if (width == 1 && height == 1)
+				break;
+
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+	}
+
+	bool readCache(const std::string& cachePath, uint64_t sourceSize, int64_t sourceMtime, bool flip, CompressedImage& image)
+	{
+		FilePtr file(std::fopen(cachePath.c_str(), "rb"));
+		if (!file)
+			return false;
+
+		uint32_t magic;
+		DDSHeader header;
+		if (std::fread(&magic, sizeof(magic), 1, file.get()) != 1 || std::fread(&header, sizeof(header), 1, file.get()) != 1)
+			return false;
+
+		auto const& key = header.reserved1;
+		if (magic != kDDSMagic ||
+			key[kKeyTag] != kCacheTag ||
+			key[kKeyVersion] != kCacheVersion ||
+			key[kKeySizeLo] != uint32_t(sourceSize) || key[kKeySizeHi] != uint32_t(sourceSize >> 32) ||
+			key[kKeyMtimeLo] != uint32_t(sourceMtime) || key[kKeyMtimeHi] != uint32_t(uint64_t(sourceMtime) >> 32) ||
+			key[kKeyFlip] != uint32_t(flip))
+		{
+			return false;
+		}
+
+		bool hasAlpha;
+		if (header.pixelFormat.fourCC == fourCC('D', 'X', 'T', '1'))
+			hasAlpha = false;
+		else if (header.pixelFormat.fourCC == fourCC('D', 'X', 'T', '5'))
+			hasAlpha = true;
+		else
+			return false;
+
+		if (header.width == 0 || header.height == 0 || header.width > kMaxCachedSize || header.height > kMaxCachedSize)
+			return false;
+
+		computeLevels(int(header.width), int(header.height), hasAlpha, image);
+		if (image.levels.size() != header.mipMapCount)
+			return false;
+
+		// A header that disagrees with the file's size (corrupt or truncated)
+		// must not turn into a huge allocation; the texture is re-cooked.
+		auto const dataSize = image.levels.back().offset + image.levels.back().size;
+
+		std::error_code ec;
+		auto const fileSize = std::filesystem::file_size(cachePath, ec);
+		if (ec || fileSize != sizeof(magic) + sizeof(DDSHeader) + dataSize)
+			return false;
+
+		image.format = hasAlpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		image.data.resize(dataSize);
+
+		return std::fread(image.data.data(), 1, image.data.size(), file.get()) == image.data.size();
+	}
+
+	void writeCache(const std::string& cachePath, uint64_t sourceSize, int64_t sourceMtime, bool flip, const CompressedImage& image)
+	{
+		bool const hasAlpha = image.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+		DDSHeader header = {};
+		header.size = sizeof(DDSHeader);
+		header.flags = kDDSDCaps | kDDSDHeight | kDDSDWidth | kDDSDPixelFormat | kDDSDMipMapCount | kDDSDLinearSize;
+		header.height = uint32_t(image.levels[0].height);
+		header.width = uint32_t(image.levels[0].width);
+		header.pitchOrLinearSize = uint32_t(image.levels[0].size);
+		header.mipMapCount = uint32_t(image.levels.size());
+		header.pixelFormat.size = sizeof(DDSPixelFormat);
+		header.pixelFormat.flags = kDDPFFourCC;
+		header.pixelFormat.fourCC = hasAlpha ? fourCC('D', 'X', 'T', '5') : fourCC('D', 'X', 'T', '1');
+		header.caps = kDDSCapsTexture | kDDSCapsComplex | kDDSCapsMipMap;
+
+		auto& key = header.reserved1;
+		key[kKeyTag] = kCacheTag;
+		key[kKeyVersion] = kCacheVersion;
+		key[kKeySizeLo] = uint32_t(sourceSize);
+		key[kKeySizeHi] = uint32_t(sourceSize >> 32);
+		key[kKeyMtimeLo] = uint32_t(sourceMtime);
+		key[kKeyMtimeHi] = uint32_t(uint64_t(sourceMtime) >> 32);
+		key[kKeyFlip] = uint32_t(flip);
+
+		// Write next to the final file and move it into place, so readers
+		// never see a partially written cache.
+		auto const tempPath = cachePath + ".tmp";
+
+		{
+			FilePtr file(std::fopen(tempPath.c_str(), "wb"));
+			if (!file)
+			{
+				std::cerr << "TextureCache: unable to create '" << tempPath << "'\n";
+				return;
+			}
+
+			if (std::fwrite(&kDDSMagic, sizeof(kDDSMagic), 1, file.get()) != 1 ||
+				std::fwrite(&header, sizeof(header), 1, file.get()) != 1 ||
+				std::fwrite(image.data.data(), 1, image.data.size(), file.get()) != image.data.size())
+			{
+				std::cerr << "TextureCache: error while writing '" << tempPath << "'\n";
+				file.reset();
+				std::remove(tempPath.c_str());
+				return;
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tempPath, cachePath, ec);
+
+		if (ec)
+		{
+			std::cerr << "TextureCache: unable to replace '" << cachePath << "': " << ec.message() << "\n";
+			std::remove(tempPath.c_str());
+		}
+	}
+
+	bool cook(const std::string& path, bool flip, CompressedImage& image)
+	{
+		ImageData source;
+		if (!decodeImage(path, flip, source))
+			return false;
+
+		// Expand to RGBA8, which is what the encoder and mip builder expect.
+		std::vector<unsigned char> rgba(size_t(source.width) * source.height * 4);
+		bool hasAlpha = false;
+
+		for (size_t i = 0, n = size_t(source.width) * source.height; i < n; ++i)
+		{
+			const unsigned char* src = source.pixels.data() + i * source.channels;
+			unsigned char* dst = rgba.data() + i * 4;
+
+			switch (source.channels)
+			{
+			case 1: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break;
+			case 2: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+			case 3: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; break;
+			default: std::memcpy(dst, src, 4); break;
+			}
+
+			hasAlpha = hasAlpha || dst[3] != 255;
+		}
+
+		int const width = source.width;
+		int const height = source.height;
+		source = ImageData{};
+
+		image.format = hasAlpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		computeLevels(width, height, hasAlpha, image);
+
+		image.data.clear();
+		image.data.reserve(image.levels.back().offset + image.levels.back().size);
+
+		std::vector<unsigned char> next;
+		for (size_t i = 0; i < image.levels.size(); ++i)
+		{
+			auto const& level = image.levels[i];
+
+			if (hasAlpha)
+				encodeBC3(rgba.data(), level.width, level.height, image.data);
+			else
+				encodeBC1(rgba.data(), level.width, level.height, image.data);
+
+			if (i + 1 < image.levels.size())
+			{
+				downsampleRGBA(rgba.data(), level.width, level.height, next);
+				rgba.swap(next);
+			}
+		}
+
+		return true;
+	}
+}
+
+bool loadCompressedImage(const std::string& path, bool flipVertically, CompressedImage& image)
+{
+	uint64_t size;
+	int64_t mtime;
+	if (!sourceStamp(path, size, mtime))
+	{
+		std::cerr << "Texture failed to load at path: " << path << "\n";
+		return false;
+	}
+
+	auto const cachePath = path + ".dds";
+
+	if (readCache(cachePath, size, mtime, flipVertically, image))
+		return true;
+
+	auto const start = Clock::now();
+
+	if (!cook(path, flipVertically, image))
+		return false;
+
+	auto const elapsed = std::chrono::duration_cast<Secondsf>(Clock::now() - start).count();
+	std::printf("TextureCache: cooked '%s' (%dx%d, %zu levels, %zu KiB) in %.1f ms\n",
+		path.c_str(), image.levels[0].width, image.levels[0].height, image.levels.size(), image.data.size() / 1024, elapsed * 1000.0f);
+
+	writeCache(cachePath, size, mtime, flipVertically, image);
+
+	return true;
+}
+
+bool compressedTexturesSupported()
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for (GLint i = 0; i < count; ++i)
+	{
+		auto const name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+		if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad.h>
+
+#include <string>
+#include <vector>
+
+// Block-compressed texture with a prebuilt mip chain, as stored in the cooked
+// texture cache.
+struct CompressedImage
+{
+	struct Level
+	{
+		int width;
+		int height;
+		size_t offset;
+		size_t size;
+	};
+
+	GLenum format = 0;
+	std::vector<Level> levels;
+	std::vector<unsigned char> data;
+
+	bool empty() const { return levels.empty(); }
+};
+
+// Cooked texture cache. For a source image "foo.png", the cache is a DDS file
+// "foo.png.dds" holding BC1 (opaque) or BC3 (with alpha) data and a full mip
+// chain. The source's size and modification time (and the flip flag) are
+// recorded in the DDS header's reserved words; a mismatch causes the cache to
+// be rebuilt.
+//
+// loadCompressedImage() returns the cached data if it is up to date, and
+// otherwise decodes the source, builds the mip chain, compresses it with the
+// built-in CPU encoder and writes a new cache. It does not touch OpenGL and
+// may run on worker threads.
+bool loadCompressedImage(const std::string& path, bool flipVertically, CompressedImage& image);
+
+// Whether the current context can sample S3TC/BC1-3 textures. Must be called
+// on the context thread.
+bool compressedTexturesSupported();
@@ -0,0 +1,256 @@
+#include "texture_streamer.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+bool bufferStorageSupported()
+{
+#	if defined(GL_VERSION_4_4)
+	if (GLAD_GL_VERSION_4_4)
+		return true;
+#	endif
+#	if defined(GL_ARB_buffer_storage)
+	if (GLAD_GL_ARB_buffer_storage)
+		return true;
+#	endif
+	return false;
+}
+
+namespace
+{
+	size_t alignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+TextureStreamer::TextureStreamer(size_t bytesPerFrame, unsigned segmentCount)
+	: mBytesPerFrame(alignUp(bytesPerFrame, 256))
+	, mSegmentCount(std::max(1u, segmentCount))
+{}
+
+TextureStreamer::~TextureStreamer()
+{
+	for (auto& segment : mSegments)
+	{
+		if (segment.fence)
+			glDeleteSync(segment.fence);
+	}
+
+	if (0 != mBuffer)
+	{
+		if (mPersistent)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		glDeleteBuffers(1, &mBuffer);
+	}
+}
+
+void TextureStreamer::enqueue(GLTexture& texture, ImageData image)
+{
+	if (image.empty())
+		return;
+
+	// Rows that do not fit into a staging segment are rare enough (more than
+	// bytesPerFrame per row) to simply be uploaded directly.
+	if (size_t(image.width) * image.channels > mBytesPerFrame)
+	{
+		texture.upload(image);
+		return;
+	}
+
+	texture.allocate(GL_TEXTURE_2D, image.width, image.height, image.channels);
+
+	auto pending = std::make_shared<PendingTexture>(PendingTexture{ &texture, 1 });
+	mQueue.push_back(Upload{ std::move(pending), GL_TEXTURE_2D, std::move(image) });
+}
+
+void TextureStreamer::enqueueCubemap(GLTexture& texture, std::vector<ImageData> faces)
+{
+	if (faces.size() != 6 || faces[0].empty())
+		return;
+
+	// The storage is allocated from face 0, so every face has to match it.
+	// A face that failed to load (or differs) leaves the cubemap to the
+	// direct upload, which skips what it cannot use.
+	bool const uniform = std::all_of(faces.begin(), faces.end(), [&faces](const ImageData& face) {
+		return !face.empty() && face.width == faces[0].width && face.height == faces[0].height && face.channels == faces[0].channels;
+	});
+
+	if (!uniform || size_t(faces[0].width) * faces[0].channels > mBytesPerFrame)
+	{
+		texture.uploadCubemap(faces);
+		return;
+	}
+
+	texture.allocate(GL_TEXTURE_CUBE_MAP, faces[0].width, faces[0].height, faces[0].channels);
+
+	auto pending = std::make_shared<PendingTexture>(PendingTexture{ &texture, 6 });
+
+	for (size_t i = 0; i < faces.size(); ++i)
+		mQueue.push_back(Upload{ pending, GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i), std::move(faces[i]) });
+}
+
+void TextureStreamer::update()
+{
+	if (mQueue.empty())
+		return;
+
+	uploadSegment(mBytesPerFrame);
+}
+
+void TextureStreamer::flush()
+{
+	while (!mQueue.empty())
+	{
+		if (!uploadSegment(mBytesPerFrame))
+		{
+			// All segments are in flight; wait for the oldest one.
+			auto& segment = mSegments[mNextSegment];
+			if (!segment.fence)
+				break;
+
+			glClientWaitSync(segment.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+		}
+	}
+}
+
+size_t TextureStreamer::pendingBytes() const
+{
+	size_t bytes = 0;
+	for (const auto& upload : mQueue)
+		bytes += upload.image.pixels.size() - size_t(upload.nextRow) * upload.image.width * upload.image.channels;
+	return bytes;
+}
+
+void TextureStreamer::createStaging()
+{
+	auto const size = GLsizeiptr(mBytesPerFrame * mSegmentCount);
+
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+
+#	if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+	if (bufferStorageSupported())
+	{
+		GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+		mPersistent = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+	}
+	else
+#	endif
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	mSegments.resize(mSegmentCount);
+	for (unsigned i = 0; i < mSegmentCount; ++i)
+		mSegments[i].offset = mBytesPerFrame * i;
+}
+
+bool TextureStreamer::uploadSegment(size_t budget)
+{
+	if (0 == mBuffer)
+		createStaging();
+
+	auto& segment = mSegments[mNextSegment];
+
+	if (segment.fence)
+	{
+		// Never stall: if the GPU is still reading this segment, try again
+		// next frame.
+		auto const status = glClientWaitSync(segment.fence, 0, 0);
+		if (GL_TIMEOUT_EXPIRED == status)
+			return false;
+
+		glDeleteSync(segment.fence);
+		segment.fence = nullptr;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+
+	unsigned char* dst = mPersistent
+		? mPersistent + segment.offset
+		: static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, GLintptr(segment.offset), GLsizeiptr(mBytesPerFrame),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+
+	if (!dst)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return false;
+	}
+
+	// Fill the segment with as many whole rows as fit into the budget.
+	std::vector<Copy> copies;
+	size_t used = 0;
+
+	while (!mQueue.empty())
+	{
+		auto& upload = mQueue.front();
+		auto const& image = upload.image;
+
+		auto const rowSize = size_t(image.width) * image.channels;
+		if (rowSize == 0)
+		{
+			// Nothing to copy; never queued by the enqueue functions, but
+			// cheap to rule out. Still counts as done for the mipmaps.
+			--upload.pending->remainingImages;
+			mQueue.pop_front();
+			continue;
+		}
+
+		auto const rowsLeft = size_t(image.height - upload.nextRow);
+		auto const rowsFit = static_cast<int>(std::min(rowsLeft, (budget - used) / rowSize));
+
+		if (rowsFit == 0)
+			break;
+
+		auto const bytes = rowSize * rowsFit;
+		std::memcpy(dst + used, image.pixels.data() + rowSize * upload.nextRow, bytes);
+
+		upload.nextRow += rowsFit;
+
+		bool const lastRows = upload.nextRow == image.height;
+		copies.push_back(Copy{ upload.pending, upload.target, image.width, image.channels, upload.nextRow - rowsFit, rowsFit, segment.offset + used, lastRows });
+
+		used = alignUp(used + bytes, 16);
+
+		if (lastRows)
+			mQueue.pop_front();
+
+		if (used >= budget)
+			break;
+	}
+
+	if (!mPersistent)
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (const auto& copy : copies)
+	{
+		auto* texture = copy.pending->texture;
+		texture->use();
+
+		glTexSubImage2D(copy.target, 0, 0, copy.firstRow, copy.width, copy.rowCount,
+			imagePixelFormat(copy.channels), GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(copy.offset));
+
+		// Once all images of a texture are in, build its mip chain.
+		if (copy.lastRows && --copy.pending->remainingImages == 0 && texture->levels() > 1)
+			glGenerateMipmap(texture->target());
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	segment.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mNextSegment = (mNextSegment + 1) % mSegmentCount;
+
+	return true;
+}
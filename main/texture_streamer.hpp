@@ -0,0 +1,95 @@
+#pragma once
+
+#include <glad.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "gl_texture.hpp"
+
+// True if immutable buffer storage (GL 4.4 / ARB_buffer_storage) is available.
+bool bufferStorageSupported();
+
+// Streams decoded images into GL textures across several frames.
+//
+// Pixels are copied into a staging pixel-unpack buffer and uploaded with
+// glTexSubImage2D from there, so the driver never has to copy (or wait on)
+// client memory. The staging buffer is split into a few segments, one per
+// frame in flight; each segment is protected by a fence and only reused once
+// the GPU has consumed it. When GL 4.4 / ARB_buffer_storage is available the
+// buffer is persistently mapped, otherwise each segment is mapped
+// unsynchronized for the duration of the copy.
+//
+// update() uploads at most bytesPerFrame bytes per call and never blocks: if
+// the next segment is still in use, the frame simply uploads nothing.
+class TextureStreamer
+{
+public:
+	explicit TextureStreamer(size_t bytesPerFrame = size_t(8) << 20, unsigned segmentCount = 3);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// Allocates storage for texture immediately and queues the pixels. The
+	// texture must outlive the upload. Mipmaps are generated once the base
+	// level is complete.
+	void enqueue(GLTexture& texture, ImageData image);
+	void enqueueCubemap(GLTexture& texture, std::vector<ImageData> faces);
+
+	// Call once per frame on the context thread.
+	void update();
+
+	// Uploads everything that is still queued, regardless of the budget.
+	void flush();
+
+	bool idle() const { return mQueue.empty(); }
+
+	size_t pendingBytes() const;
+
+private:
+	struct PendingTexture
+	{
+		GLTexture* texture;
+		unsigned remainingImages;
+	};
+
+	struct Upload
+	{
+		std::shared_ptr<PendingTexture> pending;
+		GLenum target;
+		ImageData image;
+		int nextRow = 0;
+	};
+
+	struct Segment
+	{
+		size_t offset = 0;
+		GLsync fence = nullptr;
+	};
+
+	struct Copy
+	{
+		std::shared_ptr<PendingTexture> pending;
+		GLenum target;
+		int width, channels;
+		int firstRow, rowCount;
+		size_t offset;
+		bool lastRows;
+	};
+
+	void createStaging();
+	bool uploadSegment(size_t budget);
+
+	size_t mBytesPerFrame;
+	unsigned mSegmentCount;
+
+	GLuint mBuffer = 0;
+	unsigned char* mPersistent = nullptr;
+
+	std::vector<Segment> mSegments;
+	unsigned mNextSegment = 0;
+
+	std::deque<Upload> mQueue;
+};
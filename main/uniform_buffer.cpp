@@ -0,0 +1,25 @@
+#include "uniform_buffer.hpp"
+
+void UniformRing::create(GLuint binding, size_t blockSize, StreamBuffer& stream)
+{
+	mStream = &stream;
+	mBinding = binding;
+	mBlockSize = blockSize;
+}
+
+void UniformRing::push(const void* data)
+{
+	auto const range = mStream->write(data, mBlockSize, StreamBuffer::uniformAlignment());
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, mBinding, range.buffer, range.offset, mBlockSize);
+}
+
+bool bindUniformBlock(GLuint program, const char* blockName, GLuint binding)
+{
+	GLuint const index = glGetUniformBlockIndex(program, blockName);
+	if (index == GL_INVALID_INDEX)
+		return false;
+
+	glUniformBlockBinding(program, index, binding);
+	return true;
+}
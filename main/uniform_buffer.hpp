@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "glm.hpp"
+
+#include "stream_buffer.hpp"
+
+// Binding points shared by every program. Shaders declare the blocks as
+//
+//	layout(std140, binding = 0) uniform FrameUniforms
+//	{
+//		mat4 view;
+//		mat4 projection;
+//		mat4 viewProjection;
+//		vec4 viewPosition;          // xyz
+//		vec4 lightPosition;         // xyz
+//		vec4 movingLightPosition;   // xyz
+//		vec4 ambientColor;          // rgb
+//		vec4 lightColor;            // rgb
+//		vec4 movingLightColor;      // rgb
+//		vec4 directionalLightColor; // rgb
+//		float shininess;
+//		int enableToonShading;
+//	};
+//
+//	layout(std140, binding = 1) uniform ObjectUniforms
+//	{
+//		mat4 model;
+//		mat4 normalMatrix;
+//	};
+//
+// bindUniformBlock() (below) also assigns the bindings for shaders that
+// predate explicit binding layouts.
+constexpr GLuint kFrameUniformBinding = 0;
+constexpr GLuint kObjectUniformBinding = 1;
+
+// std140 mirrors of the blocks above. vec3s are padded to vec4 on both sides
+// to keep the layouts trivially identical.
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::vec4 viewPosition;
+	glm::vec4 lightPosition;
+	glm::vec4 movingLightPosition;
+	glm::vec4 ambientColor;
+	glm::vec4 lightColor;
+	glm::vec4 movingLightColor;
+	glm::vec4 directionalLightColor;
+	float shininess;
+	int32_t enableToonShading;
+	float padding[2];
+};
+
+static_assert(sizeof(FrameUniforms) == 3 * 64 + 7 * 16 + 16, "FrameUniforms must match the std140 layout");
+
+struct ObjectUniforms
+{
+	glm::mat4 model;
+	glm::mat4 normalMatrix;
+};
+
+static_assert(sizeof(ObjectUniforms) == 2 * 64, "ObjectUniforms must match the std140 layout");
+
+// Aligned slices of one block each in a StreamBuffer, for data that changes
+// once per frame (FrameUniforms) or between draws (ObjectUniforms). push()
+// writes the next slice and binds it with glBindBufferRange, so draws never
+// overwrite each other's data and nothing is orphaned.
+class UniformRing
+{
+public:
+	// The stream must outlive the ring.
+	void create(GLuint binding, size_t blockSize, StreamBuffer& stream);
+
+	void push(const void* data);
+
+	template<typename T>
+	void push(const T& data) { push(static_cast<const void*>(&data)); }
+
+private:
+	StreamBuffer* mStream = nullptr;
+	GLuint mBinding = 0;
+	size_t mBlockSize = 0;
+};
+
+// Assigns the block's binding point in the given program. Returns false if
+// the program does not declare (or does not use) the block.
+bool bindUniformBlock(GLuint program, const char* blockName, GLuint binding);
@@ -0,0 +1,317 @@
+#include "vertex_welder.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+
+#include "defaults.hpp"
+
+static_assert(sizeof(MeshVertex) == 32, "VertexWelder hashes MeshVertex as 32 raw bytes");
+
+namespace
+{
+	constexpr uint32_t kEmptySlot = ~uint32_t(0);
+
+	// Inputs with fewer corners than this are not worth spreading over
+	// several threads.
+	constexpr size_t kParallelThreshold = size_t(1) << 18;
+
+	uint64_t mix64(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	uint64_t rotl64(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	bool sameBits(const MeshVertex& a, const MeshVertex& b)
+	{
+		return std::memcmp(&a, &b, sizeof(MeshVertex)) == 0;
+	}
+
+	size_t tableCapacity(size_t expectedCount)
+	{
+		// Keep the load factor at or below 2/3 for the expected count.
+		size_t capacity = 16;
+		while (capacity < expectedCount + expectedCount / 2)
+			capacity <<= 1;
+		return capacity;
+	}
+
+	// Shared probe loop: looks up vertex (with precomputed hash) in slots and
+	// returns the stored index, or stores and returns candidate if absent.
+	// getVertex maps a stored index back to its vertex for comparison.
+	template< typename tGetVertex >
+	uint32_t findOrInsert(VertexWelder::Slot* slots, size_t mask, uint64_t hash, const MeshVertex& vertex, uint32_t candidate, tGetVertex&& getVertex)
+	{
+		auto const tag = static_cast<uint32_t>(hash >> 32);
+
+		for (size_t i = size_t(hash) & mask;; i = (i + 1) & mask)
+		{
+			auto& slot = slots[i];
+
+			if (slot.index == kEmptySlot)
+			{
+				slot.index = candidate;
+				slot.tag = tag;
+				return candidate;
+			}
+
+			if (slot.tag == tag && sameBits(getVertex(slot.index), vertex))
+			{
+				return slot.index;
+			}
+		}
+	}
+
+	template< typename tFunc >
+	void parallelFor(unsigned threadCount, size_t count, tFunc&& func)
+	{
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount);
+
+		for (unsigned t = 0; t < threadCount; ++t)
+		{
+			size_t const begin = count * t / threadCount;
+			size_t const end = count * (t + 1) / threadCount;
+
+			threads.emplace_back([&func, begin, end] { func(begin, end); });
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+}
+
+VertexWelder::VertexWelder(std::vector<MeshVertex>& vertices, size_t expectedCount)
+	: mVertices(vertices)
+{
+	rehash(tableCapacity(std::max(expectedCount, vertices.size())));
+}
+
+uint64_t VertexWelder::hash(const MeshVertex& vertex)
+{
+	uint64_t words[4];
+	std::memcpy(words, &vertex, sizeof(words));
+
+	uint64_t h = 0x9e3779b97f4a7c15ull;
+	h = mix64(h ^ words[0]);
+	h = mix64(rotl64(h, 23) ^ words[1]);
+	h = mix64(rotl64(h, 23) ^ words[2]);
+	h = mix64(rotl64(h, 23) ^ words[3]);
+
+	return h;
+}
+
+uint32_t VertexWelder::insert(const MeshVertex& vertex)
+{
+	// Grow once the load factor exceeds 3/4 (only when the expected count
+	// passed to the constructor was too small).
+	if ((mVertices.size() + 1) * 4 > mSlots.size() * 3)
+		rehash(mSlots.size() * 2);
+
+	auto const candidate = static_cast<uint32_t>(mVertices.size());
+	auto const index = findOrInsert(mSlots.data(), mMask, hash(vertex), vertex, candidate,
+		[this](uint32_t i) -> const MeshVertex& { return mVertices[i]; });
+
+	if (index == candidate)
+		mVertices.push_back(vertex);
+
+	return index;
+}
+
+void VertexWelder::rehash(size_t capacity)
+{
+	mSlots.assign(capacity, Slot{ kEmptySlot, 0 });
+	mMask = capacity - 1;
+
+	for (uint32_t i = 0; i < mVertices.size(); ++i)
+	{
+		findOrInsert(mSlots.data(), mMask, hash(mVertices[i]), mVertices[i], i,
+			[this](uint32_t j) -> const MeshVertex& { return mVertices[j]; });
+	}
+}
+
+void weldVertices(const std::vector<MeshVertex>& corners, std::vector<MeshVertex>& vertices, std::vector<uint32_t>& indices, unsigned threadCount)
+{
+	if (0 == threadCount)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	if (threadCount == 1 || corners.size() < kParallelThreshold || !vertices.empty())
+	{
+		VertexWelder welder(vertices, corners.size());
+
+		indices.reserve(indices.size() + corners.size());
+		for (const auto& corner : corners)
+			indices.push_back(welder.insert(corner));
+
+		return;
+	}
+
+	auto const count = corners.size();
+
+	// 1. Hash all corners in parallel.
+	std::vector<uint64_t> hashes(count);
+	parallelFor(threadCount, count, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			hashes[i] = VertexWelder::hash(corners[i]);
+	});
+
+	// 2. Bucket corners into shards by the top bits of their hash. Equal
+	// vertices always land in the same shard, so shards can be welded
+	// independently. The scatter is stable, so every shard lists its corners
+	// in their original order.
+	unsigned shardBits = 0;
+	while ((1u << shardBits) < threadCount * 4)
+		++shardBits;
+
+	auto const shardCount = size_t(1) << shardBits;
+	auto const shardOf = [shardBits](uint64_t h) { return size_t(h >> (64 - shardBits)); };
+
+	std::vector<size_t> shardStart(shardCount + 1, 0);
+	for (auto const h : hashes)
+		++shardStart[shardOf(h) + 1];
+	for (size_t s = 0; s < shardCount; ++s)
+		shardStart[s + 1] += shardStart[s];
+
+	std::vector<uint32_t> order(count);
+	{
+		auto cursor = shardStart;
+		for (uint32_t i = 0; i < count; ++i)
+			order[cursor[shardOf(hashes[i])]++] = i;
+	}
+
+	// 3. Weld each shard, recording for every corner the first corner with
+	// the same value (its representative).
+	auto const base = indices.size();
+	indices.resize(base + count);
+	uint32_t* representative = indices.data() + base;
+
+	std::atomic<size_t> nextShard{ 0 };
+	parallelFor(threadCount, threadCount, [&](size_t, size_t) {
+		std::vector<VertexWelder::Slot> slots;
+
+		for (size_t s; (s = nextShard.fetch_add(1)) < shardCount;)
+		{
+			auto const begin = shardStart[s];
+			auto const end = shardStart[s + 1];
+
+			auto const capacity = tableCapacity(end - begin);
+			slots.assign(capacity, VertexWelder::Slot{ kEmptySlot, 0 });
+
+			for (size_t k = begin; k < end; ++k)
+			{
+				auto const i = order[k];
+				representative[i] = findOrInsert(slots.data(), capacity - 1, hashes[i], corners[i], i,
+					[&corners](uint32_t j) -> const MeshVertex& { return corners[j]; });
+			}
+		}
+	});
+
+	// 4. Number the representatives in corner order. A representative always
+	// precedes the corners that refer to it, so its final index is known by
+	// the time they are reached.
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (representative[i] == i)
+		{
+			representative[i] = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(corners[i]);
+		}
+		else
+		{
+			representative[i] = representative[representative[i]];
+		}
+	}
+}
+
+void benchmarkVertexWelding(const std::vector<std::string>& paths)
+{
+	constexpr int kRepetitions = 5;
+
+	auto const threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	auto const bestOf = [](auto&& func) {
+		float best = 1e30f;
+		for (int i = 0; i < kRepetitions; ++i)
+		{
+			auto const start = Clock::now();
+			func();
+			best = std::min(best, std::chrono::duration_cast<Secondsf>(Clock::now() - start).count());
+		}
+		return best * 1000.0f;
+	};
+
+	std::printf("%-44s %10s %10s %12s %12s %12s\n", "model", "corners", "unique", "map (ms)", "welder (ms)", "sharded (ms)");
+
+	for (const auto& path : paths)
+	{
+		ObjLoadOptions options = ObjLoadOptions::defaults();
+		options.useMeshCache = false;
+
+		ObjModel model;
+		if (!model.load(path, options))
+		{
+			std::fprintf(stderr, "benchmarkVertexWelding: unable to load '%s'\n", path.c_str());
+			continue;
+		}
+
+		// Rebuild the un-welded corner stream, as it comes out of the parser.
+		std::vector<MeshVertex> corners;
+		corners.reserve(model.mesh.indices.size());
+		for (auto const index : model.mesh.indices)
+			corners.push_back(model.mesh.vertices[index]);
+
+		size_t mapUnique = 0, welderUnique = 0, shardedUnique = 0;
+
+		float const mapMs = bestOf([&] {
+			std::vector<MeshVertex> vertices;
+			std::vector<uint32_t> indices;
+			std::unordered_map<MeshVertex, uint32_t> uniqueVertices;
+
+			for (const auto& vertex : corners)
+			{
+				if (uniqueVertices.count(vertex) == 0) {
+					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+					vertices.push_back(vertex);
+				}
+
+				indices.push_back(uniqueVertices[vertex]);
+			}
+
+			mapUnique = vertices.size();
+		});
+
+		float const welderMs = bestOf([&] {
+			std::vector<MeshVertex> vertices;
+			std::vector<uint32_t> indices;
+			weldVertices(corners, vertices, indices, 1);
+			welderUnique = vertices.size();
+		});
+
+		float const shardedMs = bestOf([&] {
+			std::vector<MeshVertex> vertices;
+			std::vector<uint32_t> indices;
+			weldVertices(corners, vertices, indices, threadCount);
+			shardedUnique = vertices.size();
+		});
+
+		std::printf("%-44s %10zu %10zu %12.2f %12.2f %12.2f\n", path.c_str(), corners.size(), welderUnique, mapMs, welderMs, shardedMs);
+
+		if (mapUnique != welderUnique || welderUnique != shardedUnique)
+			std::printf("  note: unique counts differ (map %zu, welder %zu, sharded %zu)\n", mapUnique, welderUnique, shardedUnique);
+	}
+
+	std::printf("(best of %d runs, sharded mode on %u threads)\n", kRepetitions, threadCount);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+#include "ObjModel.hpp"
+
+// Vertex deduplication ("welding") for the OBJ loader.
+//
+// VertexWelder is a flat open-addressing hash table that maps each distinct
+// MeshVertex to its index in an output vertex array. Inserting a vertex is a
+// single probe sequence that either finds the existing index or appends the
+// vertex. Vertices are hashed and compared as raw 32-byte values, so two
+// vertices are only welded if they are bit-for-bit identical (in particular,
+// +0.0 and -0.0 are kept apart).
+class VertexWelder
+{
+public:
+	// expectedCount is an upper bound on the number of inserts, e.g. the
+	// number of indices of the mesh. The table is sized up front so that it
+	// never needs to grow when the bound holds.
+	explicit VertexWelder(std::vector<MeshVertex>& vertices, size_t expectedCount = 0);
+
+	VertexWelder(const VertexWelder&) = delete;
+	VertexWelder& operator=(const VertexWelder&) = delete;
+
+	// Returns the index of vertex in the output array, appending it first
+	// if it was not seen before.
+	uint32_t insert(const MeshVertex& vertex);
+
+	static uint64_t hash(const MeshVertex& vertex);
+
+	struct Slot
+	{
+		uint32_t index;
+		uint32_t tag;
+	};
+
+private:
+	void rehash(size_t capacity);
+
+	std::vector<MeshVertex>& mVertices;
+	std::vector<Slot> mSlots;
+	size_t mMask = 0;
+};
+
+// Welds a stream of corners (one vertex per index) into vertices/indices.
+// Appends to both arrays and produces exactly the same output as inserting the
+// corners one by one into a VertexWelder. Large inputs are split into shards
+// by hash and welded on threadCount threads (0 = all hardware threads).
+void weldVertices(
+	const std::vector<MeshVertex>& corners,
+	std::vector<MeshVertex>& vertices,
+	std::vector<uint32_t>& indices,
+	unsigned threadCount = 0
+);
+
+// Compares the original std::unordered_map deduplication against
+// VertexWelder and the sharded weldVertices() on the given OBJ files, and
+// prints the timings to stdout.
+void benchmarkVertexWelding(const std::vector<std::string>& paths);
@@ -12,9 +12,37 @@
 #	define OGL_CHECKPOINT_DEBUG()   OGL_CHECKPOINT_ALWAYS()
 #endif
 
+// Times the enclosing scope on the GPU and the CPU (see GpuProfiler in
+// profiler.hpp). OGL_PROFILE_BEGIN()/OGL_PROFILE_END() do the same for spans
+// that are not a C++ scope. Compiled out with OGL_DISABLE_PROFILER.
+#if defined(OGL_DISABLE_PROFILER)
+#	define OGL_PROFILE_SCOPE(name)  do {} while(0)
+#	define OGL_PROFILE_BEGIN(name)  do {} while(0)
+#	define OGL_PROFILE_END()        do {} while(0)
+#else
+#	define OGL_PROFILE_SCOPE(name)  ::detail::ProfileScope OGL_PROFILE_NAME_(oglProfileScope_, __LINE__)( name )
+#	define OGL_PROFILE_BEGIN(name)  ::GpuProfiler::instance().begin( name )
+#	define OGL_PROFILE_END()        ::GpuProfiler::instance().end()
+#endif
+
+#define OGL_PROFILE_NAME_(prefix, line) OGL_PROFILE_NAME2_(prefix, line)
+#define OGL_PROFILE_NAME2_(prefix, line) prefix##line
+
+#include "profiler.hpp"
+
 namespace detail
 {
 	void check_gl_error( char const*, int );
+
+	class ProfileScope final
+	{
+		public:
+			explicit ProfileScope( char const* );
+			~ProfileScope();
+
+			ProfileScope( ProfileScope const& ) = delete;
+			ProfileScope& operator= (ProfileScope const&) = delete;
+	};
 }
 
 #endif // CHECKPOINT_HPP_3DFDA796_469C_4D37_B904_1C8D8FAE207B
@@ -80,6 +80,10 @@ namespace
 		if( GL_DEBUG_TYPE_OTHER == aType )
 			return;
 
+		// Every profiler scope is a debug group while tracing (see Tracer).
+		if( GL_DEBUG_TYPE_PUSH_GROUP == aType || GL_DEBUG_TYPE_POP_GROUP == aType )
+			return;
+
 		std::fprintf( stderr, "OpenGL Debug: %s [%s]: %s\n", severity_str_(aSeverity), type_str_(aType), aMessage );
 
 		// For high severity errors, break into the debugger now.
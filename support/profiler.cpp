@@ -0,0 +1,182 @@
+#include "profiler.hpp"
+
+#include <cstring>
+
+#include "checkpoint.hpp"
+#include "trace.hpp"
+
+GpuProfiler& GpuProfiler::instance()
+{
+	// The queries are not deleted; they go away with the context.
+	static GpuProfiler profiler;
+	return profiler;
+}
+
+void GpuProfiler::begin( char const* aName )
+{
+	// Traced even while the profiler is off.
+	auto& tracer = Tracer::instance();
+	if( tracer.enabled() )
+	{
+		glPushDebugGroup( GL_DEBUG_SOURCE_APPLICATION, 0, -1, aName );
+		tracer.begin( aName );
+		++mTraceDepth;
+	}
+
+	if( !mEnabled )
+		return;
+
+	auto& frame = mFrames[mCurrent];
+
+	GLuint query = 0;
+	if( !mQueryActive )
+	{
+		if( frame.usedQueries == frame.queries.size() )
+		{
+			frame.queries.push_back( 0 );
+			glGenQueries( 1, &frame.queries.back() );
+		}
+
+		query = frame.queries[frame.usedQueries++];
+		glBeginQuery( GL_TIME_ELAPSED, query );
+		mQueryActive = true;
+	}
+
+	mOpen.push_back( frame.samples.size() );
+	frame.samples.push_back( Sample_{ aName, query, Clock_::now(), 0.0f } );
+}
+
+void GpuProfiler::end()
+{
+	if( mTraceDepth )
+	{
+		--mTraceDepth;
+		Tracer::instance().end();
+		glPopDebugGroup();
+	}
+
+	if( mOpen.empty() )
+		return;
+
+	auto& sample = mFrames[mCurrent].samples[mOpen.back()];
+	mOpen.pop_back();
+
+	sample.cpuMs = std::chrono::duration<float, std::milli>( Clock_::now() - sample.cpuBegin ).count();
+
+	if( sample.query )
+	{
+		glEndQuery( GL_TIME_ELAPSED );
+		mQueryActive = false;
+	}
+}
+
+void GpuProfiler::endFrame()
+{
+	// Scopes left open are closed here rather than leaking into the next
+	// frame.
+	while( !mOpen.empty() || mTraceDepth )
+		end();
+
+	mEnabled = mEnabledNext;
+
+	mFrames[mCurrent].number = mFrameNumber++;
+	mCurrent = (mCurrent + 1) % kFrameLatency;
+
+	// Recorded kFrameLatency frames ago.
+	auto& frame = mFrames[mCurrent];
+	collect_( frame );
+
+	frame.samples.clear();
+	frame.usedQueries = 0;
+}
+
+void GpuProfiler::collect_( Frame_& aFrame )
+{
+	if( aFrame.samples.empty() )
+		return;
+
+	// Results become available in order, so checking the last query is
+	// enough.
+	if( aFrame.usedQueries > 0 )
+	{
+		GLint available = 0;
+		glGetQueryObjectiv( aFrame.queries[aFrame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available );
+
+		if( !available )
+		{
+			// Keep the previous results rather than wait.
+			return;
+		}
+	}
+
+	mResults.clear();
+	mResultsFrame = aFrame.number;
+
+	for( auto const& sample : aFrame.samples )
+	{
+		float gpuMs = -1.0f;
+		if( sample.query )
+		{
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v( sample.query, GL_QUERY_RESULT, &ns );
+			gpuMs = float(ns) * 1e-6f;
+		}
+
+		Result* result = nullptr;
+		for( auto& existing : mResults )
+		{
+			if( 0 == std::strcmp( existing.name, sample.name ) )
+			{
+				result = &existing;
+				break;
+			}
+		}
+
+		if( !result )
+		{
+			mResults.push_back( Result{ sample.name, gpuMs, 0.0f } );
+			result = &mResults.back();
+		}
+		else if( gpuMs >= 0.0f )
+		{
+			result->gpuMs = (result->gpuMs < 0.0f ? 0.0f : result->gpuMs) + gpuMs;
+		}
+
+		result->cpuMs += sample.cpuMs;
+	}
+}
+
+float GpuProfiler::gpuMs( char const* aName ) const noexcept
+{
+	for( auto const& result : mResults )
+	{
+		if( 0 == std::strcmp( result.name, aName ) )
+			return result.gpuMs;
+	}
+
+	return -1.0f;
+}
+
+float GpuProfiler::cpuMs( char const* aName ) const noexcept
+{
+	for( auto const& result : mResults )
+	{
+		if( 0 == std::strcmp( result.name, aName ) )
+			return result.cpuMs;
+	}
+
+	return -1.0f;
+}
+
+namespace detail
+{
+	ProfileScope::ProfileScope( char const* aName )
+	{
+		GpuProfiler::instance().begin( aName );
+	}
+
+	ProfileScope::~ProfileScope()
+	{
+		GpuProfiler::instance().end();
+	}
+}
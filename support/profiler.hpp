@@ -0,0 +1,113 @@
+#ifndef PROFILER_HPP_B5CB1D27_2458_458C_A60B_D339AFBC2974
+#define PROFILER_HPP_B5CB1D27_2458_458C_A60B_D339AFBC2974
+
+#include <glad.h>
+
+#include <chrono>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Per-pass GPU and CPU timings.
+//
+// Each scope (see OGL_PROFILE_SCOPE() in checkpoint.hpp) is wrapped in a
+// GL_TIME_ELAPSED query and timed on the CPU. Queries are multi-buffered:
+// results are collected kFrameLatency frames later, once the GPU is surely
+// done with them, so reading them never stalls. A frame whose queries are
+// still not ready is skipped and the previous results are kept.
+//
+// Scopes with the same name are summed. Elapsed queries cannot nest, so a
+// scope opened inside another one is only timed on the CPU.
+//
+// While tracing (see Tracer), each scope is also a trace event and a
+// KHR_debug group.
+class GpuProfiler final
+{
+	public:
+		struct Result
+		{
+			char const* name;
+			float gpuMs; // negative if the scope was not timed on the GPU
+			float cpuMs;
+		};
+
+		static constexpr unsigned kFrameLatency = 4;
+
+	public:
+		static GpuProfiler& instance();
+
+		GpuProfiler( GpuProfiler const& ) = delete;
+		GpuProfiler& operator= (GpuProfiler const&) = delete;
+
+	public:
+		// Names must outlive the profiler (e.g., string literals).
+		void begin( char const* aName );
+		void end();
+
+		// Call once per frame, after the last scope (e.g., after swapping
+		// buffers).
+		void endFrame();
+
+		// Timings of the most recent frame whose queries are complete, in
+		// the order the scopes were first opened.
+		std::vector<Result> const& results() const noexcept { return mResults; }
+
+		// Frames are numbered from 1, counting endFrame() calls.
+		// resultsFrame() is the frame that results() are from (0 until the
+		// first ones); it only changes when new results are collected, so
+		// consumers that accumulate them can tell fresh results from ones
+		// kept over.
+		std::uint64_t frameNumber() const noexcept { return mFrameNumber; }
+		std::uint64_t resultsFrame() const noexcept { return mResultsFrame; }
+
+		// Negative if the scope was not in that frame.
+		float gpuMs( char const* aName ) const noexcept;
+		float cpuMs( char const* aName ) const noexcept;
+
+		// Takes effect with the next frame, so that no scope is left half
+		// recorded.
+		void setEnabled( bool aEnabled ) noexcept { mEnabledNext = aEnabled; }
+		bool enabled() const noexcept { return mEnabledNext; }
+
+	private:
+		GpuProfiler() = default;
+
+		using Clock_ = std::chrono::steady_clock;
+
+		struct Sample_
+		{
+			char const* name;
+			GLuint query; // 0 if not timed on the GPU
+			Clock_::time_point cpuBegin;
+			float cpuMs;
+		};
+
+		struct Frame_
+		{
+			std::vector<GLuint> queries; // pool, grown on demand
+			std::vector<Sample_> samples;
+			std::size_t usedQueries = 0;
+			std::uint64_t number = 0;
+		};
+
+		void collect_( Frame_& );
+
+		Frame_ mFrames[kFrameLatency];
+		unsigned mCurrent = 0;
+
+		std::vector<std::size_t> mOpen; // indices into the current frame's samples
+		bool mQueryActive = false;
+
+		unsigned mTraceDepth = 0; // open Tracer scopes and KHR_debug groups
+
+		std::vector<Result> mResults;
+
+		std::uint64_t mFrameNumber = 1; // of the frame being recorded
+		std::uint64_t mResultsFrame = 0;
+
+		bool mEnabled = true;
+		bool mEnabledNext = true;
+};
+
+#endif // PROFILER_HPP_B5CB1D27_2458_458C_A60B_D339AFBC2974
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <utility>
+#include <algorithm>
 
 #include <cstdio>
 
@@ -10,12 +11,14 @@
 
 #include "error.hpp"
 #include "checkpoint.hpp"
+#include "trace.hpp"
 
 namespace
 {
 	GLuint load_shader_( 
 		GLenum aShaderType, 
-		char const* aSourcePath
+		char const* aSourcePath,
+		std::string const& aDefines
 	);
 
 	// lightweight std::experimental::scope_exit alternative
@@ -56,11 +59,13 @@ ShaderProgram::~ShaderProgram()
 ShaderProgram::ShaderProgram( ShaderProgram&& aOther ) noexcept
 	: mProgram( std::exchange( aOther.mProgram, 0 ) )
 	, mSources( std::move(aOther.mSources) )
+	, mUniforms( std::move(aOther.mUniforms) )
 {}
 ShaderProgram& ShaderProgram::operator= (ShaderProgram&& aOther) noexcept
 {
 	std::swap( mProgram, aOther.mProgram );
 	std::swap( mSources, aOther.mSources );
+	std::swap( mUniforms, aOther.mUniforms );
 	return *this;
 }
 
@@ -75,8 +80,21 @@ GLuint ShaderProgram::programId() const noexcept
 	return mProgram;
 }
 
+GLint ShaderProgram::uniformLocation( UniformId aId ) const noexcept
+{
+	auto const it = std::lower_bound( mUniforms.begin(), mUniforms.end(), aId.hash(),
+		[] (UniformEntry_ const& aEntry, std::uint32_t aHash) { return aEntry.hash < aHash; } );
+
+	if( it != mUniforms.end() && it->hash == aId.hash() )
+		return it->location;
+
+	return -1;
+}
+
 void ShaderProgram::reload()
 {
+	OGL_TRACE_SCOPE_DETAIL( "compile program", mSources.empty() ? nullptr : mSources.front().sourcePath.c_str() );
+
 	// Space to hold the shaders when we load them
 	std::vector<GLuint> shaders;
 	shaders.reserve( mSources.size() );
@@ -90,7 +108,7 @@ void ShaderProgram::reload()
 
 	// Load shaders
 	for( auto const& source : mSources )
-		shaders.emplace_back( load_shader_( source.type, source.sourcePath.c_str() ) );
+		shaders.emplace_back( load_shader_( source.type, source.sourcePath.c_str(), source.defines ) );
 
 	// Create program object
 	OGL_CHECKPOINT_ALWAYS();
@@ -145,11 +163,77 @@ void ShaderProgram::reload()
 
 	// Replace the old shader program (if any) with the new one
 	std::swap( mProgram, prog );
+
+	reflect_();
+}
+
+void ShaderProgram::reflect_()
+{
+	mUniforms.clear();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv( mProgram, GL_ACTIVE_UNIFORMS, &count );
+	glGetProgramiv( mProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength );
+
+	std::vector<GLchar> name( std::max( maxLength, GLint(1) ) );
+	std::vector<std::string> names;
+
+	for( GLint i = 0; i < count; ++i )
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		GLsizei length = 0;
+		glGetActiveUniform( mProgram, GLuint(i), GLsizei(name.size()), &length, &size, &type, name.data() );
+
+		// Arrays are reported as "name[0]"; register them under "name" as
+		// well, like glGetUniformLocation() accepts both.
+		std::string uniformName( name.data(), std::size_t(length) );
+
+		// Members of uniform blocks have no location.
+		GLint const location = glGetUniformLocation( mProgram, uniformName.c_str() );
+		if( -1 == location )
+			continue;
+
+		mUniforms.push_back( { UniformId( uniformName.c_str() ).hash(), location } );
+		names.push_back( uniformName );
+
+		auto const bracket = uniformName.find( "[0]" );
+		if( std::string::npos != bracket && bracket + 3 == uniformName.size() )
+		{
+			uniformName.resize( bracket );
+			mUniforms.push_back( { UniformId( uniformName.c_str() ).hash(), location } );
+			names.push_back( uniformName );
+		}
+	}
+
+	// Sort by hash (with the names alongside, to report collisions).
+	std::vector<std::size_t> order( mUniforms.size() );
+	for( std::size_t i = 0; i < order.size(); ++i )
+		order[i] = i;
+
+	std::sort( order.begin(), order.end(), [this] (std::size_t aA, std::size_t aB) {
+		return mUniforms[aA].hash < mUniforms[aB].hash;
+	} );
+
+	std::vector<UniformEntry_> sorted;
+	sorted.reserve( order.size() );
+
+	for( std::size_t i = 0; i < order.size(); ++i )
+	{
+		auto const& entry = mUniforms[order[i]];
+
+		if( i > 0 && sorted.back().hash == entry.hash )
+			throw Error( "Uniform name hash collision between '%s' and '%s'", names[order[i-1]].c_str(), names[order[i]].c_str() );
+
+		sorted.push_back( entry );
+	}
+
+	mUniforms = std::move(sorted);
 }
 
 namespace
 {
-	GLuint load_shader_( GLenum aShaderType, char const* aSourcePath )
+	GLuint load_shader_( GLenum aShaderType, char const* aSourcePath, std::string const& aDefines )
 	{
 		// Load the shader source code from file
 		std::vector<GLchar> source;
@@ -190,12 +274,20 @@ namespace
 
 		GLuint shader = glCreateShader( aShaderType );
 
-		// Compile shader
+		// Compile shader. The defines have to follow the #version line, which
+		// has to come first.
+		auto const versionEnd = std::find( source.begin(), source.end(), '\n' );
+		auto const split = versionEnd == source.end() ? std::size_t(0) : std::size_t(versionEnd - source.begin()) + 1;
+
 		GLchar const* sources[] = {
-			source.data()
+			source.data(),
+			aDefines.data(),
+			source.data() + split
 		};
 		GLsizei lengths[] = {
-			GLsizei(source.size())
+			GLsizei(split),
+			GLsizei(aDefines.size()),
+			GLsizei(source.size() - split)
 		};
 
 		glShaderSource( shader, sizeof(sources)/sizeof(sources[0]), sources, lengths );
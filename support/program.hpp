@@ -11,6 +11,33 @@
 
 #include "../main/glm.hpp"
 
+// Compile-time hashed uniform name (32-bit FNV-1a). Constructing one from a
+// string literal involves no allocation, and in a constant expression (e.g.,
+// a constexpr variable) no work at all at runtime.
+class UniformId final
+{
+	public:
+		constexpr UniformId( char const* aName ) noexcept
+			: mHash( hash_( aName ) )
+		{}
+
+		constexpr std::uint32_t hash() const noexcept { return mHash; }
+
+		constexpr bool operator== (UniformId aOther) const noexcept { return mHash == aOther.mHash; }
+		constexpr bool operator< (UniformId aOther) const noexcept { return mHash < aOther.mHash; }
+
+	private:
+		static constexpr std::uint32_t hash_( char const* aName ) noexcept
+		{
+			std::uint32_t h = 2166136261u;
+			for( ; *aName; ++aName )
+				h = (h ^ std::uint32_t(static_cast<unsigned char>(*aName))) * 16777619u;
+			return h;
+		}
+
+		std::uint32_t mHash;
+};
+
 class ShaderProgram final
 {
 	public:
@@ -18,6 +45,8 @@ class ShaderProgram final
 		{
 			GLenum type;
 			std::string sourcePath;
+			// Inserted after the #version line, e.g. "#define ALPHA_TEST\n".
+			std::string defines = {};
 		};
 
 	public:
@@ -40,65 +69,80 @@ class ShaderProgram final
 
 		void reload();
 
-		void setBool(const std::string& name, bool value) const
+		// Location of an active uniform, as reflected by the last reload().
+		// Returns -1 (which glUniform*() ignores) for unknown names.
+		GLint uniformLocation( UniformId aId ) const noexcept;
+
+		void setBool(UniformId name, bool value) const
 		{
-			glUniform1i(glGetUniformLocation(mProgram, name.c_str()), (int)value);
+			glUniform1i(uniformLocation(name), (int)value);
 		}
 		// ------------------------------------------------------------------------
-		void setInt(const std::string& name, int value) const
+		void setInt(UniformId name, int value) const
 		{
-			glUniform1i(glGetUniformLocation(mProgram, name.c_str()), value);
+			glUniform1i(uniformLocation(name), value);
 		}
 		// ------------------------------------------------------------------------
-		void setFloat(const std::string& name, float value) const
+		void setFloat(UniformId name, float value) const
 		{
-			glUniform1f(glGetUniformLocation(mProgram, name.c_str()), value);
+			glUniform1f(uniformLocation(name), value);
 		}
 		// ------------------------------------------------------------------------
-		void setVec2(const std::string& name, const glm::vec2& value) const
+		void setVec2(UniformId name, const glm::vec2& value) const
 		{
-			glUniform2fv(glGetUniformLocation(mProgram, name.c_str()), 1, &value[0]);
+			glUniform2fv(uniformLocation(name), 1, &value[0]);
 		}
-		void setVec2(const std::string& name, float x, float y) const
+		void setVec2(UniformId name, float x, float y) const
 		{
-			glUniform2f(glGetUniformLocation(mProgram, name.c_str()), x, y);
+			glUniform2f(uniformLocation(name), x, y);
 		}
 		// ------------------------------------------------------------------------
-		void setVec3(const std::string& name, const glm::vec3& value) const
+		void setVec3(UniformId name, const glm::vec3& value) const
 		{
-			glUniform3fv(glGetUniformLocation(mProgram, name.c_str()), 1, &value[0]);
+			glUniform3fv(uniformLocation(name), 1, &value[0]);
 		}
-		void setVec3(const std::string& name, float x, float y, float z) const
+		void setVec3(UniformId name, float x, float y, float z) const
 		{
-			glUniform3f(glGetUniformLocation(mProgram, name.c_str()), x, y, z);
+			glUniform3f(uniformLocation(name), x, y, z);
 		}
 		// ------------------------------------------------------------------------
-		void setVec4(const std::string& name, const glm::vec4& value) const
+		void setVec4(UniformId name, const glm::vec4& value) const
 		{
-			glUniform4fv(glGetUniformLocation(mProgram, name.c_str()), 1, &value[0]);
+			glUniform4fv(uniformLocation(name), 1, &value[0]);
 		}
-		void setVec4(const std::string& name, float x, float y, float z, float w)
+		void setVec4(UniformId name, float x, float y, float z, float w)
 		{
-			glUniform4f(glGetUniformLocation(mProgram, name.c_str()), x, y, z, w);
+			glUniform4f(uniformLocation(name), x, y, z, w);
 		}
 		// ------------------------------------------------------------------------
-		void setMat2(const std::string& name, const glm::mat2& mat) const
+		void setMat2(UniformId name, const glm::mat2& mat) const
 		{
-			glUniformMatrix2fv(glGetUniformLocation(mProgram, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+			glUniformMatrix2fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 		}
 		// ------------------------------------------------------------------------
-		void setMat3(const std::string& name, const glm::mat3& mat) const
+		void setMat3(UniformId name, const glm::mat3& mat) const
 		{
-			glUniformMatrix3fv(glGetUniformLocation(mProgram, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+			glUniformMatrix3fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 		}
 		// ------------------------------------------------------------------------
-		void setMat4(const std::string& name, const glm::mat4& mat) const
+		void setMat4(UniformId name, const glm::mat4& mat) const
 		{
-			glUniformMatrix4fv(glGetUniformLocation(mProgram, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+			glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 		}
 	private:
+		struct UniformEntry_
+		{
+			std::uint32_t hash;
+			GLint location;
+		};
+
+		void reflect_();
+
 		GLuint mProgram;
 		std::vector<ShaderSource> mSources;
+
+		// Sorted by hash.
+		std::vector<UniformEntry_> mUniforms;
 };
 
 #endif // PROGRAM_HPP_39793FD2_7845_47A7_9E21_6DDAD42C9A09
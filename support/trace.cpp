@@ -0,0 +1,252 @@
+#include "trace.hpp"
+
+#include <algorithm>
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// The calling thread's buffer, owned by the tracer.
+	thread_local void* tThread = nullptr;
+
+	void write_json_string_( std::FILE* aFile, char const* aString )
+	{
+		std::fputc( '"', aFile );
+
+		for( auto ptr = aString; *ptr; ++ptr )
+		{
+			auto const ch = static_cast<unsigned char>(*ptr);
+
+			if( '"' == ch || '\\' == ch )
+				std::fprintf( aFile, "\\%c", ch );
+			else if( ch < 0x20 )
+				std::fprintf( aFile, "\\u%04x", ch );
+			else
+				std::fputc( ch, aFile );
+		}
+
+		std::fputc( '"', aFile );
+	}
+}
+
+Tracer& Tracer::instance()
+{
+	static Tracer tracer;
+	return tracer;
+}
+
+Tracer::Tracer()
+	: mEpoch( Clock_::now() )
+{}
+
+Tracer::~Tracer()
+{
+	if( enabled() )
+		write();
+}
+
+void Tracer::start( char const* aOutputPath )
+{
+	mOutputPath = aOutputPath;
+	mEnabled.store( true, std::memory_order_relaxed );
+
+	std::printf( "Tracing to '%s' (F2 writes it now)\n", aOutputPath );
+}
+
+void Tracer::begin( char const* aName, char const* aDetail )
+{
+	record_( thread_(), aName, aDetail );
+}
+
+void Tracer::end()
+{
+	record_( thread_(), nullptr, nullptr );
+}
+
+void Tracer::setThreadName( char const* aName )
+{
+	if( !enabled() )
+		return;
+
+	thread_().name.store( aName, std::memory_order_release );
+}
+
+bool Tracer::write()
+{
+	return write( mOutputPath.c_str() );
+}
+
+bool Tracer::write( char const* aPath )
+{
+	std::lock_guard<std::mutex> lock( mThreadsMutex );
+
+	auto file = std::fopen( aPath, "wb" );
+	if( !file )
+	{
+		std::fprintf( stderr, "Tracer: cannot write '%s'\n", aPath );
+		return false;
+	}
+
+	std::fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+	bool first = true;
+	std::size_t written = 0;
+
+	std::vector<Event_> events;
+
+	for( auto const& thread : mThreads )
+	{
+		if( auto name = thread->name.load( std::memory_order_acquire ) )
+		{
+			std::fprintf( file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread->id );
+			write_json_string_( file, name );
+			std::fprintf( file, "}}" );
+			first = false;
+		}
+
+		// Copy the window first. The owning thread may recycle the oldest
+		// slots meanwhile; an event is kept only if its slot was not reused
+		// before the copy was done (seqlock style, see record_()).
+		auto const end = thread->written.load( std::memory_order_acquire );
+		auto const begin = end > kMaxEventsPerThread ? end - kMaxEventsPerThread : 0;
+
+		events.clear();
+		for( auto n = begin; n < end; ++n )
+		{
+			auto const& slot = thread->chunks[(n / Chunk_::kSize) % kChunksPerThread].load( std::memory_order_relaxed )->events[n % Chunk_::kSize];
+
+			events.push_back( Event_{
+				slot.name.load( std::memory_order_relaxed ),
+				slot.detail.load( std::memory_order_relaxed ),
+				slot.ns.load( std::memory_order_relaxed )
+			} );
+		}
+
+		std::atomic_thread_fence( std::memory_order_acquire );
+		auto const reused = thread->written.load( std::memory_order_relaxed );
+
+		// Event n's slot is reused by event n + kMaxEventsPerThread, which
+		// may have been partially copied once written reached that.
+		std::size_t skip = 0;
+		if( reused >= begin + kMaxEventsPerThread )
+			skip = std::min<std::size_t>( events.size(), reused - kMaxEventsPerThread + 1 - begin );
+
+		// Ends whose begins are no longer in the window are left out.
+		unsigned depth = 0;
+
+		for( std::size_t i = skip; i < events.size(); ++i )
+		{
+			auto const& event = events[i];
+
+			if( event.name )
+				++depth;
+			else if( depth )
+				--depth;
+			else
+				continue;
+
+			// Microseconds, which is what the viewers expect.
+			std::fprintf( file, "%s{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", first ? "" : ",\n", event.name ? 'B' : 'E', thread->id, double(event.ns) * 1e-3 );
+
+			if( event.name )
+			{
+				std::fprintf( file, ",\"name\":" );
+				write_json_string_( file, event.name );
+			}
+
+			if( event.detail )
+			{
+				std::fprintf( file, ",\"args\":{\"detail\":" );
+				write_json_string_( file, event.detail );
+				std::fprintf( file, "}" );
+			}
+
+			std::fprintf( file, "}" );
+			first = false;
+
+			++written;
+		}
+	}
+
+	std::fprintf( file, "\n]}\n" );
+
+	bool const ok = 0 == std::ferror( file );
+	std::fclose( file );
+
+	if( ok )
+		std::printf( "Tracer: wrote %zu events to '%s'\n", written, aPath );
+	else
+		std::fprintf( stderr, "Tracer: error writing '%s'\n", aPath );
+
+	return ok;
+}
+
+Tracer::Thread_& Tracer::thread_()
+{
+	if( tThread )
+		return *static_cast<Thread_*>(tThread);
+
+	auto thread = std::make_unique<Thread_>();
+
+	auto* const ptr = thread.get();
+	tThread = ptr;
+
+	{
+		std::lock_guard<std::mutex> lock( mThreadsMutex );
+
+		ptr->id = static_cast<unsigned>(mThreads.size()) + 1;
+		mThreads.emplace_back( std::move(thread) );
+	}
+
+	return *ptr;
+}
+
+Tracer::Thread_::~Thread_()
+{
+	for( auto& chunk : chunks )
+		delete chunk.load( std::memory_order_relaxed );
+}
+
+void Tracer::record_( Thread_& aThread, char const* aName, char const* aDetail )
+{
+	// Only this thread writes the count.
+	auto const n = aThread.written.load( std::memory_order_relaxed );
+
+	auto& chunkPtr = aThread.chunks[(n / Chunk_::kSize) % kChunksPerThread];
+	auto* chunk = chunkPtr.load( std::memory_order_relaxed );
+
+	if( !chunk )
+	{
+		// Published along with the event, by the store to written.
+		chunk = new Chunk_;
+		chunkPtr.store( chunk, std::memory_order_relaxed );
+	}
+
+	char const* detail = nullptr;
+	if( aDetail )
+	{
+		auto const length = std::strlen( aDetail ) + 1;
+		auto copy = std::make_unique<char[]>( length );
+		std::memcpy( copy.get(), aDetail, length );
+
+		detail = copy.get();
+		aThread.details.emplace_back( std::move(copy) );
+	}
+
+	auto const now = Clock_::now();
+	auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>( now - mEpoch ).count();
+
+	// Once the ring is full, this overwrites event n - kMaxEventsPerThread.
+	// The fence orders the previous store to written before the overwrite,
+	// so a write() that copies any of the new fields also sees written at n
+	// or past, and discards the slot.
+	std::atomic_thread_fence( std::memory_order_release );
+
+	auto& slot = chunk->events[n % Chunk_::kSize];
+	slot.name.store( aName, std::memory_order_relaxed );
+	slot.detail.store( detail, std::memory_order_relaxed );
+	slot.ns.store( static_cast<std::uint64_t>(ns), std::memory_order_relaxed );
+
+	aThread.written.store( n + 1, std::memory_order_release );
+}
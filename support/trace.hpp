@@ -0,0 +1,169 @@
+#ifndef TRACE_HPP_6E0F3B52_91D4_4C1A_8A7E_2F5C0D84B913
+#define TRACE_HPP_6E0F3B52_91D4_4C1A_8A7E_2F5C0D84B913
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Timeline of begin/end events on every thread, written as Chrome trace
+// JSON (chrome://tracing, ui.perfetto.dev).
+//
+// Each thread records into its own buffer, without locking; the buffer is
+// registered with the tracer on the thread's first event. Buffers are kept
+// until exit, so events of threads that have finished (e.g., the loader
+// workers) are still written.
+//
+// A buffer is a ring that holds the thread's most recent
+// kMaxEventsPerThread events; past that, the oldest chunk of events is
+// recycled for new ones. A long session therefore keeps its last few
+// minutes (at a few dozen scopes per frame and 60 FPS, 1M events are about
+// seven minutes), and write() leaves out the ends whose begins have been
+// recycled already.
+//
+// Nothing is recorded until start() is called. Profiler scopes (see
+// OGL_PROFILE_SCOPE() in checkpoint.hpp) are traced too, and are additionally
+// pushed as KHR_debug groups, so they show in GL debuggers.
+class Tracer final
+{
+	public:
+		// Per thread; the window of recent events that is kept.
+		static constexpr std::size_t kMaxEventsPerThread = std::size_t(1) << 20;
+
+	public:
+		static Tracer& instance();
+
+		Tracer( Tracer const& ) = delete;
+		Tracer& operator= (Tracer const&) = delete;
+
+		// Writes the trace, if started.
+		~Tracer();
+
+	public:
+		// Starts recording. The trace is written to aOutputPath by write()
+		// and at exit. Call before any scope is opened.
+		void start( char const* aOutputPath );
+
+		bool enabled() const noexcept { return mEnabled.load( std::memory_order_relaxed ); }
+
+		// Names must outlive the tracer (e.g., string literals). The detail,
+		// if any, is copied (e.g., a file name).
+		void begin( char const* aName, char const* aDetail = nullptr );
+		void end();
+
+		// Shown as the name of the calling thread's track. Ignored until
+		// start().
+		void setThreadName( char const* aName );
+
+		// Writes the events recorded so far that are still in the window;
+		// other threads may keep recording meanwhile.
+		bool write();
+		bool write( char const* aPath );
+
+	private:
+		Tracer();
+
+		using Clock_ = std::chrono::steady_clock;
+
+		struct Event_
+		{
+			char const* name; // nullptr for ends
+			char const* detail;
+			std::uint64_t ns;
+		};
+
+		// Event_, as stored: write() may read a slot while the owning
+		// thread recycles it, so the fields are atomics (relaxed; see
+		// record_() and write() for the ordering).
+		struct Slot_
+		{
+			std::atomic<char const*> name;
+			std::atomic<char const*> detail;
+			std::atomic<std::uint64_t> ns;
+		};
+
+		struct Chunk_
+		{
+			static constexpr std::size_t kSize = 4096;
+
+			Slot_ events[kSize];
+		};
+
+		static constexpr std::size_t kChunksPerThread = kMaxEventsPerThread / Chunk_::kSize;
+		static_assert( kMaxEventsPerThread % Chunk_::kSize == 0, "The window must be whole chunks" );
+
+		// Event n goes to slot n % kMaxEventsPerThread. Chunks are allocated
+		// as the ring first fills up; written is published after each event.
+		struct Thread_
+		{
+			unsigned id;
+			std::atomic<char const*> name{ nullptr };
+
+			std::atomic<Chunk_*> chunks[kChunksPerThread] = {};
+			std::atomic<std::uint64_t> written{ 0 };
+
+			// Kept for the whole run, even once their events are recycled;
+			// they are rare (e.g., file loads).
+			std::vector<std::unique_ptr<char[]>> details;
+
+			~Thread_();
+		};
+
+		Thread_& thread_();
+		void record_( Thread_&, char const*, char const* );
+
+		std::atomic<bool> mEnabled{ false };
+		std::string mOutputPath;
+
+		Clock_::time_point mEpoch;
+
+		std::mutex mThreadsMutex; // registration and write()
+		std::vector<std::unique_ptr<Thread_>> mThreads;
+};
+
+// Traces the enclosing scope on the calling thread (CPU only; see
+// OGL_PROFILE_SCOPE() for GL work). OGL_TRACE_SCOPE_DETAIL() adds a string,
+// such as the file being loaded. Compiled out with OGL_DISABLE_TRACE.
+#if defined(OGL_DISABLE_TRACE)
+#	define OGL_TRACE_SCOPE(name)                do {} while(0)
+#	define OGL_TRACE_SCOPE_DETAIL(name, info)   do {} while(0)
+#else
+#	define OGL_TRACE_SCOPE(name)                ::detail::TraceScope OGL_TRACE_NAME_(oglTraceScope_, __LINE__)( name )
+#	define OGL_TRACE_SCOPE_DETAIL(name, info)   ::detail::TraceScope OGL_TRACE_NAME_(oglTraceScope_, __LINE__)( name, info )
+#endif
+
+#define OGL_TRACE_NAME_(prefix, line) OGL_TRACE_NAME2_(prefix, line)
+#define OGL_TRACE_NAME2_(prefix, line) prefix##line
+
+namespace detail
+{
+	class TraceScope final
+	{
+		public:
+			explicit TraceScope( char const* aName, char const* aDetail = nullptr )
+				: mActive( Tracer::instance().enabled() )
+			{
+				if( mActive )
+					Tracer::instance().begin( aName, aDetail );
+			}
+
+			~TraceScope()
+			{
+				if( mActive )
+					Tracer::instance().end();
+			}
+
+			TraceScope( TraceScope const& ) = delete;
+			TraceScope& operator= (TraceScope const&) = delete;
+
+		private:
+			bool mActive;
+	};
+}
+
+#endif // TRACE_HPP_6E0F3B52_91D4_4C1A_8A7E_2F5C0D84B913